@@ -0,0 +1,318 @@
+#include "ndi5-buffer-pool.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace NDI5Filter::Buffers {
+
+// Reserved huge pages need setting up by whoever runs the machine (and on
+// Windows a privilege OBS is rarely given) -- stop asking once refused
+static std::atomic<bool> huge_only_refused{false};
+
+static size_t round_up(size_t size, size_t to)
+{
+	return (size + to - 1) / to * to;
+}
+
+// What allocate will take for size, near enough to hold the cap to
+static size_t capacity_for(size_t size)
+{
+	if (size < HUGE_PAGE_THRESHOLD)
+		return round_up(size, ALIGNMENT);
+
+	return round_up(size, HUGE_PAGE_SIZE);
+}
+
+static block allocate(size_t size)
+{
+	block b = {nullptr, capacity_for(size), BACKING_HEAP};
+
+	if (size < HUGE_PAGE_THRESHOLD) {
+#ifdef _WIN32
+		b.data = static_cast<uint8_t *>(
+			_aligned_malloc(b.capacity, ALIGNMENT));
+#else
+		void *ptr = nullptr;
+		if (posix_memalign(&ptr, ALIGNMENT, b.capacity) == 0)
+			b.data = static_cast<uint8_t *>(ptr);
+#endif
+		return b;
+	}
+
+#ifdef _WIN32
+	const size_t large = GetLargePageMinimum();
+
+	if (large && !huge_only_refused) {
+		const size_t capacity = round_up(b.capacity, large);
+
+		void *ptr = VirtualAlloc(nullptr, capacity,
+					 MEM_RESERVE | MEM_COMMIT |
+						 MEM_LARGE_PAGES,
+					 PAGE_READWRITE);
+		if (ptr) {
+			b.data = static_cast<uint8_t *>(ptr);
+			b.capacity = capacity;
+			b.kind = BACKING_HUGE_ONLY;
+			return b;
+		}
+
+		huge_only_refused = true;
+	}
+
+	b.data = static_cast<uint8_t *>(VirtualAlloc(
+		nullptr, b.capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	b.kind = BACKING_PAGES;
+#else
+#ifdef MAP_HUGETLB
+	if (!huge_only_refused) {
+		void *ptr = mmap(nullptr, b.capacity, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+				 0);
+		if (ptr != MAP_FAILED) {
+			b.data = static_cast<uint8_t *>(ptr);
+			b.kind = BACKING_HUGE_ONLY;
+			return b;
+		}
+
+		huge_only_refused = true;
+	}
+#endif
+
+	// Map a huge page more than needed and keep the aligned middle, a
+	// transparent huge page can only back an aligned 2 MB range
+	const size_t span = b.capacity + HUGE_PAGE_SIZE;
+
+	void *base = mmap(nullptr, span, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return b;
+
+	auto start = static_cast<uint8_t *>(base);
+	auto aligned = reinterpret_cast<uint8_t *>(
+		round_up(reinterpret_cast<uintptr_t>(start), HUGE_PAGE_SIZE));
+
+	const size_t head = aligned - start;
+	const size_t tail = span - head - b.capacity;
+
+	if (head)
+		munmap(start, head);
+	if (tail)
+		munmap(aligned + b.capacity, tail);
+
+	b.data = aligned;
+	b.kind = BACKING_PAGES;
+
+#ifdef MADV_HUGEPAGE
+	if (madvise(b.data, b.capacity, MADV_HUGEPAGE) == 0)
+		b.kind = BACKING_HUGE;
+#endif
+#endif
+
+	return b;
+}
+
+static void deallocate(const block &b)
+{
+	if (b.kind == BACKING_HEAP) {
+#ifdef _WIN32
+		_aligned_free(b.data);
+#else
+		free(b.data);
+#endif
+		return;
+	}
+
+#ifdef _WIN32
+	VirtualFree(b.data, 0, MEM_RELEASE);
+#else
+	munmap(b.data, b.capacity);
+#endif
+}
+
+pool::~pool()
+{
+	trim();
+}
+
+block pool::acquire(size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// The smallest released block that holds it without wasting most of
+	// itself
+	int best = -1;
+
+	for (int i = 0; i < free_count_; i++) {
+		const size_t capacity = free_[i].capacity;
+
+		if (capacity < size || capacity / REUSE_SLACK > size)
+			continue;
+
+		if (best < 0 || capacity < free_[best].capacity)
+			best = i;
+	}
+
+	if (best >= 0) {
+		block b = free_[best];
+
+		// Keep the rest oldest first
+		for (int i = best; i + 1 < free_count_; i++)
+			free_[i] = free_[i + 1];
+		free_count_--;
+		free_bytes_ -= b.capacity;
+
+		reuses_++;
+		pressure_ = false;
+		return b;
+	}
+
+	// Blocks nobody is using go first, then the request
+	const uint64_t cap = cap_;
+	const size_t capacity = capacity_for(size);
+
+	while (cap && bytes_ + capacity > cap && free_count_)
+		free_oldest();
+
+	if (cap && bytes_ + capacity > cap) {
+		refusals_++;
+		pressure_ = true;
+		return {};
+	}
+
+	block b = allocate(size);
+
+	if (b.data) {
+		pressure_ = false;
+		allocations_++;
+		bytes_ += b.capacity;
+
+		if (b.kind == BACKING_HUGE || b.kind == BACKING_HUGE_ONLY)
+			huge_bytes_ += b.capacity;
+	}
+
+	return b;
+}
+
+void pool::release(block &b)
+{
+	if (!b.data)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Over a cap lowered while it was out, or more than the free list
+	// may hold on its own
+	const uint64_t cap = cap_;
+
+	if ((cap && bytes_ > cap) || b.capacity > FREE_BYTES) {
+		free_block(b);
+		b = {};
+		return;
+	}
+
+	while (free_count_ == FREE_BLOCKS ||
+	       free_bytes_ + b.capacity > FREE_BYTES)
+		free_oldest();
+
+	free_[free_count_++] = b;
+	free_bytes_ += b.capacity;
+	b = {};
+}
+
+void pool::trim()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (int i = 0; i < free_count_; i++)
+		free_block(free_[i]);
+
+	free_count_ = 0;
+	free_bytes_ = 0;
+}
+
+void pool::set_cap(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	cap_ = bytes;
+
+	while (bytes && bytes_ > bytes && free_count_)
+		free_oldest();
+}
+
+bool pool::pressure() const
+{
+	return pressure_;
+}
+
+stats pool::get_stats() const
+{
+	stats s;
+	s.allocations = allocations_;
+	s.reuses = reuses_;
+	s.frees = frees_;
+	s.refusals = refusals_;
+	s.bytes = bytes_;
+	s.huge_bytes = huge_bytes_;
+	s.cap = cap_;
+	return s;
+}
+
+void pool::free_block(const block &b)
+{
+	deallocate(b);
+
+	frees_++;
+	bytes_ -= b.capacity;
+
+	if (b.kind == BACKING_HUGE || b.kind == BACKING_HUGE_ONLY)
+		huge_bytes_ -= b.capacity;
+}
+
+void pool::free_oldest()
+{
+	free_block(free_[0]);
+	free_bytes_ -= free_[0].capacity;
+
+	for (int i = 1; i < free_count_; i++)
+		free_[i - 1] = free_[i];
+	free_count_--;
+}
+
+bool set::create(pool &p, uint32_t count, size_t size)
+{
+	destroy(p);
+
+	uint64_t bytes = 0;
+
+	for (uint32_t i = 0; i < count && i < SET_MAX; i++) {
+		blocks_[i] = p.acquire(size);
+
+		if (!blocks_[i].data) {
+			destroy(p);
+			return false;
+		}
+
+		bytes += blocks_[i].capacity;
+	}
+
+	bytes_ = bytes;
+	allocated_ = true;
+	return true;
+}
+
+void set::destroy(pool &p)
+{
+	for (auto &b : blocks_)
+		p.release(b);
+
+	allocated_ = false;
+	bytes_ = 0;
+}
+
+} // namespace NDI5Filter::Buffers
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame buffer pool for the NDI send path
+//
+// Blocks start on a cache line, which also covers the alignment of every SIMD
+// store the kernels make, and are never zero filled -- the copy writes every
+// byte NDI shows before the first send. Blocks of HUGE_PAGE_THRESHOLD and up
+// come straight from the OS, page aligned and on huge pages where the OS has
+// them. A released block is kept and handed back out to a later request it
+// can hold, so rebuilding a pool at the same (or a nearby) size allocates
+// nothing.
+//
+// One pool is shared by every filter in the module. It may be capped, past
+// the cap released blocks are freed to make room and then requests are
+// refused -- the caller drops the frame and the pool reports pressure until
+// a request succeeds again. Acquire and release take the pool's lock, the
+// stats never do.
+
+namespace NDI5Filter::Buffers {
+
+constexpr size_t ALIGNMENT = 64;
+
+// x86 and most ARM64 kernels use 2 MB huge pages, frames smaller than one
+// stay on the heap
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t HUGE_PAGE_THRESHOLD = HUGE_PAGE_SIZE;
+
+// Released blocks kept for reuse across every filter, the oldest is freed
+// past either bound -- 256 MB holds a full pool up to 1440p BGRA, a 4K
+// rebuild allocates its last block again
+constexpr int FREE_BLOCKS = 16;
+constexpr size_t FREE_BYTES = 256 * 1024 * 1024;
+
+// A free block is only reused for a request at least 1/REUSE_SLACK its size
+constexpr size_t REUSE_SLACK = 4;
+
+// Most blocks one owner sends from
+constexpr uint32_t SET_MAX = 8;
+
+enum backing : uint32_t {
+	BACKING_HEAP = 0,  // aligned malloc
+	BACKING_PAGES,     // OS pages, the OS may still merge them into huge
+	BACKING_HUGE,      // transparent huge pages asked for (Linux)
+	BACKING_HUGE_ONLY, // MAP_HUGETLB / MEM_LARGE_PAGES, reserved up front
+};
+
+struct block {
+	uint8_t *data;
+	size_t capacity;
+	backing kind;
+};
+
+struct stats {
+	uint64_t allocations; // blocks taken from the OS or heap
+	uint64_t reuses;      // requests served from a released block
+	uint64_t frees;       // blocks given back
+	uint64_t refusals;    // requests turned away at the cap
+	uint64_t bytes;       // held, in use and free
+	uint64_t huge_bytes;  // of which on huge pages
+	uint64_t cap;         // bytes, 0 for none
+};
+
+class pool {
+public:
+	pool() = default;
+	pool(const pool &) = delete;
+	pool &operator=(const pool &) = delete;
+	~pool();
+
+	// At least size bytes, data is nullptr if nothing could be allocated or
+	// the cap would be passed
+	block acquire(size_t size);
+
+	// Back to the free list, b is cleared
+	void release(block &b);
+
+	// Frees every released block, a filter going away leaves nothing
+	// behind
+	void trim();
+
+	// Bytes, 0 for none. Blocks already out are kept, a lower cap is
+	// reached as they come back.
+	void set_cap(uint64_t bytes);
+
+	// A request was refused and nothing has succeeded since -- owners that
+	// can spare their blocks should give them back
+	bool pressure() const;
+
+	stats get_stats() const;
+
+private:
+	void free_block(const block &b);
+	void free_oldest();
+
+	std::mutex mutex_;
+	block free_[FREE_BLOCKS] = {};
+	int free_count_ = 0;
+	size_t free_bytes_ = 0;
+
+	// Read by the properties view without the lock
+	std::atomic<uint64_t> allocations_{0};
+	std::atomic<uint64_t> reuses_{0};
+	std::atomic<uint64_t> frees_{0};
+	std::atomic<uint64_t> refusals_{0};
+	std::atomic<uint64_t> bytes_{0};
+	std::atomic<uint64_t> huge_bytes_{0};
+	std::atomic<uint64_t> cap_{0};
+	std::atomic<bool> pressure_{false};
+};
+
+// One owner's frame buffers, every block the same size. Built whole or not at
+// all -- a refused block hands the rest back. Allocated and bytes may be read
+// from any thread.
+class set {
+public:
+	set() = default;
+	set(const set &) = delete;
+	set &operator=(const set &) = delete;
+
+	// count blocks of at least size bytes, any held go back first. False if
+	// the pool refused one, nothing is held then.
+	bool create(pool &p, uint32_t count, size_t size);
+
+	// Back to the pool
+	void destroy(pool &p);
+
+	bool allocated() const { return allocated_; }
+	uint64_t bytes() const { return bytes_; } // blocks may outsize frames
+	uint8_t *data(uint32_t i) const { return blocks_[i].data; }
+
+private:
+	block blocks_[SET_MAX] = {};
+	std::atomic<bool> allocated_{false};
+	std::atomic<uint64_t> bytes_{0};
+};
+
+} // namespace NDI5Filter::Buffers
@@ -0,0 +1,1193 @@
+#include "ndi5-pixel-kernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+	defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang need every function that uses intrinsics above the baseline
+// to be tagged, MSVC lets us use them anywhere
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET(x) __attribute__((target(x)))
+#else
+#define KERNEL_TARGET(x)
+#endif
+
+namespace NDI5Filter::Kernels {
+
+void color_matrix(bool bt601, bool full_range, float out[3][4])
+{
+	const float kr = bt601 ? 0.299f : 0.2126f;
+	const float kb = bt601 ? 0.114f : 0.0722f;
+	const float kg = 1.0f - kr - kb;
+
+	const float y_scale = full_range ? 1.0f : 219.0f / 255.0f;
+	const float y_offset = full_range ? 0.0f : 16.0f / 255.0f;
+	const float c_scale = full_range ? 1.0f : 224.0f / 255.0f;
+	const float c_offset = 128.0f / 255.0f;
+
+	const float cb = c_scale / (2.0f * (1.0f - kb));
+	const float cr = c_scale / (2.0f * (1.0f - kr));
+
+	const float matrix[3][4] = {
+		{kr * y_scale, kg * y_scale, kb * y_scale, y_offset},
+		{-kr * cb, -kg * cb, (1.0f - kb) * cb, c_offset},
+		{(1.0f - kr) * cr, -kg * cr, -kb * cr, c_offset},
+	};
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			out[row][col] = matrix[row][col];
+}
+
+coefficients make_coefficients(bool bt601, bool full_range)
+{
+	float matrix[3][4];
+	color_matrix(bt601, full_range, matrix);
+
+	const float one = (float)(1 << COEFFICIENT_SHIFT);
+	const int32_t round = 1 << (COEFFICIENT_SHIFT - 1);
+
+	coefficients c = {};
+
+	for (int i = 0; i < 3; i++) {
+		c.y[i] = (int16_t)lroundf(matrix[0][i] * one);
+		c.u[i] = (int16_t)lroundf(matrix[1][i] * one);
+		c.v[i] = (int16_t)lroundf(matrix[2][i] * one);
+	}
+
+	c.y_offset = (int32_t)lroundf(matrix[0][3] * 255.0f * one) + round;
+	c.c_offset = (int32_t)lroundf(matrix[1][3] * 255.0f * one) + round;
+
+	return c;
+}
+
+uint32_t frame_stride(format fmt, uint32_t width)
+{
+	switch (fmt) {
+	case FORMAT_UYVY:
+	case FORMAT_UYVA:
+		return ((width + 1) / 2) * 4;
+	case FORMAT_BGRX:
+		return width * 4;
+	case FORMAT_NV12:
+		return (width + 1) & ~1u;
+	}
+	return width * 4;
+}
+
+size_t frame_size(format fmt, uint32_t stride, uint32_t height)
+{
+	const size_t plane = (size_t)stride * height;
+
+	switch (fmt) {
+	case FORMAT_UYVA:
+		return plane + (size_t)(stride / 2) * height;
+	case FORMAT_NV12:
+		return plane + (size_t)stride * ((height + 1) / 2);
+	default:
+		return plane;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Scalar reference                                                          */
+
+static inline uint8_t clamp_u8(int32_t value)
+{
+	return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+static inline uint8_t apply(const int16_t *k, int32_t offset, int32_t r,
+			    int32_t g, int32_t b)
+{
+	return clamp_u8((k[0] * r + k[1] * g + k[2] * b + offset) >>
+			COEFFICIENT_SHIFT);
+}
+
+static void scalar_uyvy_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+			    const coefficients *c)
+{
+	for (uint32_t x = 0; x < width; x += 2, dst += 4) {
+		const uint8_t *p0 = src + x * 4;
+		const uint8_t *p1 = x + 1 < width ? p0 + 4 : p0;
+
+		const int32_t r = (p0[0] + p1[0] + 1) >> 1;
+		const int32_t g = (p0[1] + p1[1] + 1) >> 1;
+		const int32_t b = (p0[2] + p1[2] + 1) >> 1;
+
+		dst[0] = apply(c->u, c->c_offset, r, g, b);
+		dst[1] = apply(c->y, c->y_offset, p0[0], p0[1], p0[2]);
+		dst[2] = apply(c->v, c->c_offset, r, g, b);
+		dst[3] = apply(c->y, c->y_offset, p1[0], p1[1], p1[2]);
+	}
+}
+
+static void scalar_y_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+			 const coefficients *c)
+{
+	for (uint32_t x = 0; x < width; x++, src += 4)
+		dst[x] = apply(c->y, c->y_offset, src[0], src[1], src[2]);
+}
+
+static void scalar_uv_row(const uint8_t *src0, const uint8_t *src1,
+			  uint8_t *dst, uint32_t width, const coefficients *c)
+{
+	for (uint32_t x = 0; x < width; x += 2, dst += 2) {
+		const uint32_t x1 = x + 1 < width ? x + 1 : x;
+
+		const uint8_t *a = src0 + x * 4;
+		const uint8_t *b = src0 + x1 * 4;
+		const uint8_t *d = src1 + x * 4;
+		const uint8_t *e = src1 + x1 * 4;
+
+		const int32_t r = (a[0] + b[0] + d[0] + e[0] + 2) >> 2;
+		const int32_t g = (a[1] + b[1] + d[1] + e[1] + 2) >> 2;
+		const int32_t bl = (a[2] + b[2] + d[2] + e[2] + 2) >> 2;
+
+		dst[0] = apply(c->u, c->c_offset, r, g, bl);
+		dst[1] = apply(c->v, c->c_offset, r, g, bl);
+	}
+}
+
+static void scalar_alpha_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++)
+		dst[x] = src[x * 4 + 3];
+}
+
+static void scalar_bgrx_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++, src += 4, dst += 4) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = 255;
+	}
+}
+
+static void scalar_stream(const uint8_t *src, uint8_t *dst, size_t bytes)
+{
+	memcpy(dst, src, bytes);
+}
+
+static void scalar_fence(void) {}
+
+static const kernels scalar_kernels = {
+	"scalar",      ISA_SCALAR,       scalar_uyvy_row, scalar_y_row,
+	scalar_uv_row, scalar_alpha_row, scalar_bgrx_row, scalar_stream,
+	scalar_stream, scalar_stream,    scalar_fence,
+};
+
+/* ------------------------------------------------------------------------- */
+/* x86                                                                       */
+
+#ifdef KERNELS_X86
+
+// Sums adjacent 32 bit pairs of a and b -> { a0+a1, a2+a3, b0+b1, b2+b3 }
+KERNEL_TARGET("sse2")
+static inline __m128i sse2_hsum_pairs(__m128i a, __m128i b)
+{
+	const __m128 fa = _mm_castsi128_ps(a);
+	const __m128 fb = _mm_castsi128_ps(b);
+
+	const __m128i even = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	const __m128i odd = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm_add_epi32(even, odd);
+}
+
+// lo / hi hold two 16 bit RGBA pixels each -> four 32 bit results
+KERNEL_TARGET("sse2")
+static inline __m128i sse2_dot4(__m128i lo, __m128i hi, __m128i k,
+				__m128i offset)
+{
+	const __m128i sum = sse2_hsum_pairs(_mm_madd_epi16(lo, k),
+					    _mm_madd_epi16(hi, k));
+	return _mm_srai_epi32(_mm_add_epi32(sum, offset), COEFFICIENT_SHIFT);
+}
+
+KERNEL_TARGET("sse2")
+static inline __m128i sse2_coefficients(const int16_t *k)
+{
+	const __m128i row = _mm_loadl_epi64((const __m128i *)k);
+	return _mm_unpacklo_epi64(row, row);
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_uyvy_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+			  const coefficients *c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ky = sse2_coefficients(c->y);
+	const __m128i ku = sse2_coefficients(c->u);
+	const __m128i kv = sse2_coefficients(c->v);
+	const __m128i y_offset = _mm_set1_epi32(c->y_offset);
+	const __m128i c_offset = _mm_set1_epi32(c->c_offset);
+
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i *)(src));
+		const __m128i p1 = _mm_loadu_si128((const __m128i *)(src + 16));
+
+		const __m128i y0 = sse2_dot4(_mm_unpacklo_epi8(p0, zero),
+					     _mm_unpackhi_epi8(p0, zero), ky,
+					     y_offset);
+		const __m128i y1 = sse2_dot4(_mm_unpacklo_epi8(p1, zero),
+					     _mm_unpackhi_epi8(p1, zero), ky,
+					     y_offset);
+		const __m128i y16 = _mm_packs_epi32(y0, y1);
+
+		// Horizontal pair averages, (a + b + 1) >> 1 like the reference
+		const __m128i a0 = _mm_avg_epu8(
+			p0, _mm_shuffle_epi32(p0, _MM_SHUFFLE(2, 3, 0, 1)));
+		const __m128i a1 = _mm_avg_epu8(
+			p1, _mm_shuffle_epi32(p1, _MM_SHUFFLE(2, 3, 0, 1)));
+		const __m128i avg = _mm_castps_si128(
+			_mm_shuffle_ps(_mm_castsi128_ps(a0),
+				       _mm_castsi128_ps(a1),
+				       _MM_SHUFFLE(2, 0, 2, 0)));
+
+		const __m128i lo = _mm_unpacklo_epi8(avg, zero);
+		const __m128i hi = _mm_unpackhi_epi8(avg, zero);
+
+		const __m128i u = sse2_dot4(lo, hi, ku, c_offset);
+		const __m128i v = sse2_dot4(lo, hi, kv, c_offset);
+
+		const __m128i uv16 = _mm_packs_epi32(u, v);
+		const __m128i uv =
+			_mm_unpacklo_epi16(uv16, _mm_srli_si128(uv16, 8));
+
+		const __m128i out = _mm_packus_epi16(_mm_unpacklo_epi16(uv, y16),
+						     _mm_unpackhi_epi16(uv, y16));
+
+		_mm_storeu_si128((__m128i *)dst, out);
+
+		src += 32;
+		dst += 16;
+	}
+
+	scalar_uyvy_row(src, dst, width - x, c);
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_y_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+		       const coefficients *c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ky = sse2_coefficients(c->y);
+	const __m128i y_offset = _mm_set1_epi32(c->y_offset);
+
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i *)(src));
+		const __m128i p1 = _mm_loadu_si128((const __m128i *)(src + 16));
+
+		const __m128i y0 = sse2_dot4(_mm_unpacklo_epi8(p0, zero),
+					     _mm_unpackhi_epi8(p0, zero), ky,
+					     y_offset);
+		const __m128i y1 = sse2_dot4(_mm_unpacklo_epi8(p1, zero),
+					     _mm_unpackhi_epi8(p1, zero), ky,
+					     y_offset);
+		const __m128i y16 = _mm_packs_epi32(y0, y1);
+
+		_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(y16, y16));
+
+		src += 32;
+		dst += 8;
+	}
+
+	scalar_y_row(src, dst, width - x, c);
+}
+
+// Sum of the two 16 bit pixels in each half, left in the low half
+KERNEL_TARGET("sse2")
+static inline __m128i sse2_pair_sum(__m128i pixels)
+{
+	return _mm_add_epi16(pixels, _mm_shuffle_epi32(pixels,
+						       _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_uv_row(const uint8_t *src0, const uint8_t *src1,
+			uint8_t *dst, uint32_t width, const coefficients *c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i ku = sse2_coefficients(c->u);
+	const __m128i kv = sse2_coefficients(c->v);
+	const __m128i c_offset = _mm_set1_epi32(c->c_offset);
+
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const __m128i r0a = _mm_loadu_si128((const __m128i *)(src0));
+		const __m128i r0b =
+			_mm_loadu_si128((const __m128i *)(src0 + 16));
+		const __m128i r1a = _mm_loadu_si128((const __m128i *)(src1));
+		const __m128i r1b =
+			_mm_loadu_si128((const __m128i *)(src1 + 16));
+
+		// Column sums of the two rows
+		const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(r0a, zero),
+						  _mm_unpacklo_epi8(r1a, zero));
+		const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(r0a, zero),
+						  _mm_unpackhi_epi8(r1a, zero));
+		const __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(r0b, zero),
+						  _mm_unpacklo_epi8(r1b, zero));
+		const __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(r0b, zero),
+						  _mm_unpackhi_epi8(r1b, zero));
+
+		// 2x2 block averages, (sum + 2) >> 2 like the reference
+		__m128i lo = _mm_unpacklo_epi64(sse2_pair_sum(s01),
+						sse2_pair_sum(s23));
+		__m128i hi = _mm_unpacklo_epi64(sse2_pair_sum(s45),
+						sse2_pair_sum(s67));
+
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+
+		const __m128i u = sse2_dot4(lo, hi, ku, c_offset);
+		const __m128i v = sse2_dot4(lo, hi, kv, c_offset);
+
+		const __m128i uv16 = _mm_packs_epi32(u, v);
+		const __m128i uv =
+			_mm_unpacklo_epi16(uv16, _mm_srli_si128(uv16, 8));
+
+		_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(uv, uv));
+
+		src0 += 32;
+		src1 += 32;
+		dst += 8;
+	}
+
+	scalar_uv_row(src0, src1, dst, width - x, c);
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_alpha_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i a0 = _mm_srli_epi32(
+			_mm_loadu_si128((const __m128i *)(src)), 24);
+		const __m128i a1 = _mm_srli_epi32(
+			_mm_loadu_si128((const __m128i *)(src + 16)), 24);
+		const __m128i a2 = _mm_srli_epi32(
+			_mm_loadu_si128((const __m128i *)(src + 32)), 24);
+		const __m128i a3 = _mm_srli_epi32(
+			_mm_loadu_si128((const __m128i *)(src + 48)), 24);
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_packus_epi16(_mm_packs_epi32(a0, a1),
+						  _mm_packs_epi32(a2, a3)));
+
+		src += 64;
+		dst += 16;
+	}
+
+	scalar_alpha_row(src, dst, width - x);
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_bgrx_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+	const __m128i g_mask = _mm_set1_epi32(0x0000FF00);
+	const __m128i x_bits = _mm_set1_epi32((int)0xFF000000);
+
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		const __m128i p = _mm_loadu_si128((const __m128i *)src);
+		const __m128i rb = _mm_and_si128(p, rb_mask);
+		const __m128i br = _mm_or_si128(_mm_slli_epi32(rb, 16),
+						_mm_srli_epi32(rb, 16));
+
+		const __m128i out = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(br, rb_mask),
+				     _mm_and_si128(p, g_mask)),
+			x_bits);
+
+		_mm_storeu_si128((__m128i *)dst, out);
+
+		src += 16;
+		dst += 16;
+	}
+
+	scalar_bgrx_row(src, dst, width - x);
+}
+
+KERNEL_TARGET("ssse3")
+static void ssse3_alpha_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	// Gathers the 4 alpha bytes of a load into dword 0..3
+	const __m128i m0 = _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1,
+					 -1, -1, -1, -1, -1, -1);
+	const __m128i m1 = _mm_setr_epi8(-1, -1, -1, -1, 3, 7, 11, 15, -1, -1,
+					 -1, -1, -1, -1, -1, -1);
+	const __m128i m2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 3, 7,
+					 11, 15, -1, -1, -1, -1);
+	const __m128i m3 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+					 -1, -1, -1, 3, 7, 11, 15);
+
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i a0 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src)), m0);
+		const __m128i a1 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src + 16)), m1);
+		const __m128i a2 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src + 32)), m2);
+		const __m128i a3 = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)(src + 48)), m3);
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_or_si128(_mm_or_si128(a0, a1),
+					      _mm_or_si128(a2, a3)));
+
+		src += 64;
+		dst += 16;
+	}
+
+	scalar_alpha_row(src, dst, width - x);
+}
+
+KERNEL_TARGET("ssse3")
+static void ssse3_bgrx_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8,
+					   -1, 14, 13, 12, -1);
+	const __m128i x_bits = _mm_set1_epi32((int)0xFF000000);
+
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		const __m128i p = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_or_si128(_mm_shuffle_epi8(p, mask),
+					      x_bits));
+
+		src += 16;
+		dst += 16;
+	}
+
+	scalar_bgrx_row(src, dst, width - x);
+}
+
+// AVX2 works on two independent 128 bit lanes, results are put back into
+// pixel order with a cross lane permute at the end of each kernel
+
+KERNEL_TARGET("avx2")
+static inline __m256i avx2_dot4(__m256i lo, __m256i hi, __m256i k,
+				__m256i offset)
+{
+	const __m256 fa = _mm256_castsi256_ps(_mm256_madd_epi16(lo, k));
+	const __m256 fb = _mm256_castsi256_ps(_mm256_madd_epi16(hi, k));
+
+	const __m256i even = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	const __m256i odd = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm256_srai_epi32(
+		_mm256_add_epi32(_mm256_add_epi32(even, odd), offset),
+		COEFFICIENT_SHIFT);
+}
+
+KERNEL_TARGET("avx2")
+static inline __m256i avx2_coefficients(const int16_t *k)
+{
+	int64_t row;
+	memcpy(&row, k, sizeof(row));
+	return _mm256_set1_epi64x(row);
+}
+
+// 16 pixels -> 16 bit luma, lanes hold { 0-3, 8-11 | 4-7, 12-15 }
+KERNEL_TARGET("avx2")
+static inline __m256i avx2_luma16(__m256i p0, __m256i p1, __m256i ky,
+				  __m256i y_offset)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	const __m256i y0 = avx2_dot4(_mm256_unpacklo_epi8(p0, zero),
+				     _mm256_unpackhi_epi8(p0, zero), ky,
+				     y_offset);
+	const __m256i y1 = avx2_dot4(_mm256_unpacklo_epi8(p1, zero),
+				     _mm256_unpackhi_epi8(p1, zero), ky,
+				     y_offset);
+
+	return _mm256_packs_epi32(y0, y1);
+}
+
+KERNEL_TARGET("avx2")
+static void avx2_uyvy_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+			  const coefficients *c)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ky = avx2_coefficients(c->y);
+	const __m256i ku = avx2_coefficients(c->u);
+	const __m256i kv = avx2_coefficients(c->v);
+	const __m256i y_offset = _mm256_set1_epi32(c->y_offset);
+	const __m256i c_offset = _mm256_set1_epi32(c->c_offset);
+
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m256i p0 = _mm256_loadu_si256((const __m256i *)(src));
+		const __m256i p1 =
+			_mm256_loadu_si256((const __m256i *)(src + 32));
+
+		const __m256i y16 = avx2_luma16(p0, p1, ky, y_offset);
+
+		const __m256i a0 = _mm256_avg_epu8(
+			p0, _mm256_shuffle_epi32(p0, _MM_SHUFFLE(2, 3, 0, 1)));
+		const __m256i a1 = _mm256_avg_epu8(
+			p1, _mm256_shuffle_epi32(p1, _MM_SHUFFLE(2, 3, 0, 1)));
+		const __m256i avg = _mm256_castps_si256(
+			_mm256_shuffle_ps(_mm256_castsi256_ps(a0),
+					  _mm256_castsi256_ps(a1),
+					  _MM_SHUFFLE(2, 0, 2, 0)));
+
+		const __m256i lo = _mm256_unpacklo_epi8(avg, zero);
+		const __m256i hi = _mm256_unpackhi_epi8(avg, zero);
+
+		const __m256i u = avx2_dot4(lo, hi, ku, c_offset);
+		const __m256i v = avx2_dot4(lo, hi, kv, c_offset);
+
+		const __m256i uv16 = _mm256_packs_epi32(u, v);
+		const __m256i uv = _mm256_unpacklo_epi16(
+			uv16, _mm256_srli_si256(uv16, 8));
+
+		const __m256i out = _mm256_packus_epi16(
+			_mm256_unpacklo_epi16(uv, y16),
+			_mm256_unpackhi_epi16(uv, y16));
+
+		_mm256_storeu_si256(
+			(__m256i *)dst,
+			_mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0)));
+
+		src += 64;
+		dst += 32;
+	}
+
+	scalar_uyvy_row(src, dst, width - x, c);
+}
+
+KERNEL_TARGET("avx2")
+static void avx2_y_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+		       const coefficients *c)
+{
+	const __m256i ky = avx2_coefficients(c->y);
+	const __m256i y_offset = _mm256_set1_epi32(c->y_offset);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m256i p0 = _mm256_loadu_si256((const __m256i *)(src));
+		const __m256i p1 =
+			_mm256_loadu_si256((const __m256i *)(src + 32));
+
+		const __m256i y16 = avx2_luma16(p0, p1, ky, y_offset);
+		const __m256i y8 = _mm256_permutevar8x32_epi32(
+			_mm256_packus_epi16(y16, y16), order);
+
+		_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(y8));
+
+		src += 64;
+		dst += 16;
+	}
+
+	scalar_y_row(src, dst, width - x, c);
+}
+
+KERNEL_TARGET("avx2")
+static void avx2_bgrx_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	const __m256i mask = _mm256_setr_epi8(
+		2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1, 2, 1,
+		0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+	const __m256i x_bits = _mm256_set1_epi32((int)0xFF000000);
+
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		const __m256i p = _mm256_loadu_si256((const __m256i *)src);
+
+		_mm256_storeu_si256(
+			(__m256i *)dst,
+			_mm256_or_si256(_mm256_shuffle_epi8(p, mask), x_bits));
+
+		src += 32;
+		dst += 32;
+	}
+
+	scalar_bgrx_row(src, dst, width - x);
+}
+
+// Bytes until p is 16 byte aligned, capped at bytes
+static inline size_t align_head(const void *p, size_t bytes)
+{
+	const size_t head = (16 - ((uintptr_t)p & 15)) & 15;
+	return head < bytes ? head : bytes;
+}
+
+// Regular loads, non-temporal stores
+KERNEL_TARGET("sse2")
+static void sse2_stream_store(const uint8_t *src, uint8_t *dst, size_t bytes)
+{
+	const size_t head = align_head(dst, bytes);
+
+	memcpy(dst, src, head);
+	src += head;
+	dst += head;
+	bytes -= head;
+
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)(src));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+		const __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+
+		_mm_stream_si128((__m128i *)(dst), a);
+		_mm_stream_si128((__m128i *)(dst + 16), b);
+		_mm_stream_si128((__m128i *)(dst + 32), c);
+		_mm_stream_si128((__m128i *)(dst + 48), d);
+	}
+
+	for (; bytes >= 16; bytes -= 16, src += 16, dst += 16)
+		_mm_stream_si128((__m128i *)dst,
+				 _mm_loadu_si128((const __m128i *)src));
+
+	memcpy(dst, src, bytes);
+}
+
+KERNEL_TARGET("sse2")
+static void sse2_fence(void)
+{
+	_mm_sfence();
+}
+
+// Streaming loads (movntdqa) into cached memory
+KERNEL_TARGET("sse4.1")
+static void sse41_stream_load(const uint8_t *src, uint8_t *dst, size_t bytes)
+{
+	const size_t head = align_head(src, bytes);
+
+	memcpy(dst, src, head);
+	src += head;
+	dst += head;
+	bytes -= head;
+
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64) {
+		__m128i *p = (__m128i *)src;
+
+		const __m128i a = _mm_stream_load_si128(p);
+		const __m128i b = _mm_stream_load_si128(p + 1);
+		const __m128i c = _mm_stream_load_si128(p + 2);
+		const __m128i d = _mm_stream_load_si128(p + 3);
+
+		_mm_storeu_si128((__m128i *)(dst), a);
+		_mm_storeu_si128((__m128i *)(dst + 16), b);
+		_mm_storeu_si128((__m128i *)(dst + 32), c);
+		_mm_storeu_si128((__m128i *)(dst + 48), d);
+	}
+
+	for (; bytes >= 16; bytes -= 16, src += 16, dst += 16)
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_stream_load_si128((__m128i *)src));
+
+	memcpy(dst, src, bytes);
+}
+
+// Streaming loads and non-temporal stores, only when both ends line up
+KERNEL_TARGET("sse4.1")
+static void sse41_stream_copy(const uint8_t *src, uint8_t *dst, size_t bytes)
+{
+	if (((uintptr_t)src & 15) != ((uintptr_t)dst & 15)) {
+		sse2_stream_store(src, dst, bytes);
+		return;
+	}
+
+	const size_t head = align_head(src, bytes);
+
+	memcpy(dst, src, head);
+	src += head;
+	dst += head;
+	bytes -= head;
+
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64) {
+		__m128i *p = (__m128i *)src;
+
+		const __m128i a = _mm_stream_load_si128(p);
+		const __m128i b = _mm_stream_load_si128(p + 1);
+		const __m128i c = _mm_stream_load_si128(p + 2);
+		const __m128i d = _mm_stream_load_si128(p + 3);
+
+		_mm_stream_si128((__m128i *)(dst), a);
+		_mm_stream_si128((__m128i *)(dst + 16), b);
+		_mm_stream_si128((__m128i *)(dst + 32), c);
+		_mm_stream_si128((__m128i *)(dst + 48), d);
+	}
+
+	for (; bytes >= 16; bytes -= 16, src += 16, dst += 16)
+		_mm_stream_si128((__m128i *)dst,
+				 _mm_stream_load_si128((__m128i *)src));
+
+	memcpy(dst, src, bytes);
+}
+
+static const kernels sse2_kernels = {
+	"sse2",           ISA_SSE2,          sse2_uyvy_row,
+	sse2_y_row,       sse2_uv_row,       sse2_alpha_row,
+	sse2_bgrx_row,    scalar_stream,     sse2_stream_store,
+	sse2_stream_store, sse2_fence,
+};
+
+// phaddd is slower than the SSE2 shuffle+add, SSSE3 only wins on shuffles
+static const kernels ssse3_kernels = {
+	"ssse3",          ISA_SSSE3,         sse2_uyvy_row,
+	sse2_y_row,       sse2_uv_row,       ssse3_alpha_row,
+	ssse3_bgrx_row,   scalar_stream,     sse2_stream_store,
+	sse2_stream_store, sse2_fence,
+};
+
+// SSE4.1 only adds movntdqa for reading staging memory
+static const kernels sse41_kernels = {
+	"sse4.1",         ISA_SSE41,         sse2_uyvy_row,
+	sse2_y_row,       sse2_uv_row,       ssse3_alpha_row,
+	ssse3_bgrx_row,   sse41_stream_load, sse2_stream_store,
+	sse41_stream_copy, sse2_fence,
+};
+
+static const kernels avx2_kernels = {
+	"avx2",           ISA_AVX2,          avx2_uyvy_row,
+	avx2_y_row,       sse2_uv_row,       ssse3_alpha_row,
+	avx2_bgrx_row,    sse41_stream_load, sse2_stream_store,
+	sse41_stream_copy, sse2_fence,
+};
+
+static bool cpu_supports(isa id)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool ssse3 = (info[2] & (1 << 9)) != 0;
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	bool avx2 = false;
+	if (max_leaf >= 7 && osxsave && avx &&
+	    (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	const bool sse2 = __builtin_cpu_supports("sse2");
+	const bool ssse3 = __builtin_cpu_supports("ssse3");
+	const bool sse41 = __builtin_cpu_supports("sse4.1");
+	const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	switch (id) {
+	case ISA_SCALAR:
+		return true;
+	case ISA_SSE2:
+		return sse2;
+	case ISA_SSSE3:
+		return sse2 && ssse3;
+	case ISA_SSE41:
+		return sse2 && ssse3 && sse41;
+	case ISA_AVX2:
+		return sse2 && ssse3 && sse41 && avx2;
+	default:
+		return false;
+	}
+}
+
+#endif // KERNELS_X86
+
+/* ------------------------------------------------------------------------- */
+/* ARM                                                                       */
+
+#ifdef KERNELS_NEON
+
+// 8 pixels of 16 bit r/g/b -> 8 bit results
+static inline uint8x8_t neon_apply(const int16_t *k, int32_t offset,
+				   int16x8_t r, int16x8_t g, int16x8_t b)
+{
+	const int32x4_t base = vdupq_n_s32(offset);
+
+	int32x4_t lo = vmlal_n_s16(base, vget_low_s16(r), k[0]);
+	lo = vmlal_n_s16(lo, vget_low_s16(g), k[1]);
+	lo = vmlal_n_s16(lo, vget_low_s16(b), k[2]);
+
+	int32x4_t hi = vmlal_n_s16(base, vget_high_s16(r), k[0]);
+	hi = vmlal_n_s16(hi, vget_high_s16(g), k[1]);
+	hi = vmlal_n_s16(hi, vget_high_s16(b), k[2]);
+
+	const int16x8_t packed =
+		vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, COEFFICIENT_SHIFT)),
+			     vqmovn_s32(vshrq_n_s32(hi, COEFFICIENT_SHIFT)));
+
+	return vqmovun_s16(packed);
+}
+
+static inline int16x8_t neon_widen_low(uint8x16_t v)
+{
+	return vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v)));
+}
+
+static inline int16x8_t neon_widen_high(uint8x16_t v)
+{
+	return vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v)));
+}
+
+static inline uint8x16_t neon_luma16(const uint8x16x4_t &p,
+				     const coefficients *c)
+{
+	return vcombine_u8(neon_apply(c->y, c->y_offset,
+				      neon_widen_low(p.val[0]),
+				      neon_widen_low(p.val[1]),
+				      neon_widen_low(p.val[2])),
+			   neon_apply(c->y, c->y_offset,
+				      neon_widen_high(p.val[0]),
+				      neon_widen_high(p.val[1]),
+				      neon_widen_high(p.val[2])));
+}
+
+static void neon_uyvy_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+			  const coefficients *c)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const uint8x16x4_t p = vld4q_u8(src);
+
+		const uint8x16x2_t y = vuzpq_u8(neon_luma16(p, c),
+						neon_luma16(p, c));
+
+		// Pair averages, vrshr gives (a + b + 1) >> 1
+		const int16x8_t r = vreinterpretq_s16_u16(
+			vrshrq_n_u16(vpaddlq_u8(p.val[0]), 1));
+		const int16x8_t g = vreinterpretq_s16_u16(
+			vrshrq_n_u16(vpaddlq_u8(p.val[1]), 1));
+		const int16x8_t b = vreinterpretq_s16_u16(
+			vrshrq_n_u16(vpaddlq_u8(p.val[2]), 1));
+
+		uint8x8x4_t out;
+		out.val[0] = neon_apply(c->u, c->c_offset, r, g, b);
+		out.val[1] = vget_low_u8(y.val[0]);
+		out.val[2] = neon_apply(c->v, c->c_offset, r, g, b);
+		out.val[3] = vget_low_u8(y.val[1]);
+
+		vst4_u8(dst, out);
+
+		src += 64;
+		dst += 32;
+	}
+
+	scalar_uyvy_row(src, dst, width - x, c);
+}
+
+static void neon_y_row(const uint8_t *src, uint8_t *dst, uint32_t width,
+		       const coefficients *c)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		vst1q_u8(dst, neon_luma16(vld4q_u8(src), c));
+
+		src += 64;
+		dst += 16;
+	}
+
+	scalar_y_row(src, dst, width - x, c);
+}
+
+static void neon_uv_row(const uint8_t *src0, const uint8_t *src1,
+			uint8_t *dst, uint32_t width, const coefficients *c)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const uint8x16x4_t p0 = vld4q_u8(src0);
+		const uint8x16x4_t p1 = vld4q_u8(src1);
+
+		// 2x2 sums, vrshr gives (sum + 2) >> 2
+		const int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vaddq_u16(vpaddlq_u8(p0.val[0]), vpaddlq_u8(p1.val[0])),
+			2));
+		const int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vaddq_u16(vpaddlq_u8(p0.val[1]), vpaddlq_u8(p1.val[1])),
+			2));
+		const int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vaddq_u16(vpaddlq_u8(p0.val[2]), vpaddlq_u8(p1.val[2])),
+			2));
+
+		uint8x8x2_t out;
+		out.val[0] = neon_apply(c->u, c->c_offset, r, g, b);
+		out.val[1] = neon_apply(c->v, c->c_offset, r, g, b);
+
+		vst2_u8(dst, out);
+
+		src0 += 64;
+		src1 += 64;
+		dst += 16;
+	}
+
+	scalar_uv_row(src0, src1, dst, width - x, c);
+}
+
+static void neon_alpha_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		vst1q_u8(dst, vld4q_u8(src).val[3]);
+
+		src += 64;
+		dst += 16;
+	}
+
+	scalar_alpha_row(src, dst, width - x);
+}
+
+static void neon_bgrx_row(const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const uint8x16x4_t p = vld4q_u8(src);
+
+		uint8x16x4_t out;
+		out.val[0] = p.val[2];
+		out.val[1] = p.val[1];
+		out.val[2] = p.val[0];
+		out.val[3] = vdupq_n_u8(255);
+
+		vst4q_u8(dst, out);
+
+		src += 64;
+		dst += 64;
+	}
+
+	scalar_bgrx_row(src, dst, width - x);
+}
+
+// No movntdqa equivalent worth having, staging memory is cached on ARM
+static const kernels neon_kernels = {
+	"neon",      ISA_NEON,       neon_uyvy_row, neon_y_row,
+	neon_uv_row, neon_alpha_row, neon_bgrx_row, scalar_stream,
+	scalar_stream, scalar_stream, scalar_fence,
+};
+
+#endif // KERNELS_NEON
+
+/* ------------------------------------------------------------------------- */
+/* Dispatch                                                                  */
+
+const kernels *get(isa id)
+{
+	switch (id) {
+	case ISA_SCALAR:
+		return &scalar_kernels;
+#ifdef KERNELS_X86
+	case ISA_SSE2:
+		return cpu_supports(id) ? &sse2_kernels : nullptr;
+	case ISA_SSSE3:
+		return cpu_supports(id) ? &ssse3_kernels : nullptr;
+	case ISA_SSE41:
+		return cpu_supports(id) ? &sse41_kernels : nullptr;
+	case ISA_AVX2:
+		return cpu_supports(id) ? &avx2_kernels : nullptr;
+#endif
+#ifdef KERNELS_NEON
+	case ISA_NEON:
+		return &neon_kernels;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+const kernels *detect()
+{
+	static const kernels *best = [] {
+		for (uint32_t id = ISA_COUNT - 1; id > ISA_SCALAR; id--) {
+			if (auto k = get((isa)id))
+				return k;
+		}
+		return &scalar_kernels;
+	}();
+
+	return best;
+}
+
+void convert_frame(const kernels *k, format fmt, const uint8_t *src,
+		   uint32_t src_linesize, uint8_t *dst, uint32_t dst_stride,
+		   uint32_t width, uint32_t height, const coefficients *c)
+{
+	switch (fmt) {
+	case FORMAT_UYVA: {
+		// Alpha plane follows the UYVY plane at half its stride
+		uint8_t *alpha = dst + (size_t)dst_stride * height;
+		const uint32_t alpha_stride = dst_stride / 2;
+
+		for (uint32_t y = 0; y < height; y++)
+			k->alpha_row(src + (size_t)y * src_linesize,
+				     alpha + (size_t)y * alpha_stride, width);
+	}
+		[[fallthrough]];
+	case FORMAT_UYVY:
+		for (uint32_t y = 0; y < height; y++)
+			k->uyvy_row(src + (size_t)y * src_linesize,
+				    dst + (size_t)y * dst_stride, width, c);
+		break;
+
+	case FORMAT_BGRX:
+		for (uint32_t y = 0; y < height; y++)
+			k->bgrx_row(src + (size_t)y * src_linesize,
+				    dst + (size_t)y * dst_stride, width);
+		break;
+
+	case FORMAT_NV12: {
+		uint8_t *uv = dst + (size_t)dst_stride * height;
+
+		for (uint32_t y = 0; y < height; y++)
+			k->y_row(src + (size_t)y * src_linesize,
+				 dst + (size_t)y * dst_stride, width, c);
+
+		for (uint32_t y = 0; y < height; y += 2) {
+			const uint32_t y1 = y + 1 < height ? y + 1 : y;
+
+			k->uv_row(src + (size_t)y * src_linesize,
+				  src + (size_t)y1 * src_linesize,
+				  uv + (size_t)(y / 2) * dst_stride, width, c);
+		}
+		break;
+	}
+	}
+}
+
+// Pixels per block, sized so the in/out scratch stays in L1/L2
+constexpr uint32_t STREAM_BLOCK = 2048;
+
+void convert_frame_streaming(const kernels *k, format fmt, const uint8_t *src,
+			     uint32_t src_linesize, uint8_t *dst,
+			     uint32_t dst_stride, uint32_t width,
+			     uint32_t height, const coefficients *c)
+{
+	alignas(64) uint8_t in0[STREAM_BLOCK * 4];
+	alignas(64) uint8_t in1[STREAM_BLOCK * 4];
+	alignas(64) uint8_t out[STREAM_BLOCK * 4];
+
+	uint8_t *plane = dst + (size_t)dst_stride * height;
+
+	// NV12 walks two rows at a time so each source row is still read once
+	const uint32_t rows = fmt == FORMAT_NV12 ? 2 : 1;
+
+	for (uint32_t y = 0; y < height; y += rows) {
+		const uint32_t y1 = y + 1 < height ? y + 1 : y;
+
+		const uint8_t *row0 = src + (size_t)y * src_linesize;
+		const uint8_t *row1 = src + (size_t)y1 * src_linesize;
+
+		uint8_t *dst0 = dst + (size_t)y * dst_stride;
+		uint8_t *dst1 = dst + (size_t)y1 * dst_stride;
+
+		for (uint32_t x = 0; x < width; x += STREAM_BLOCK) {
+			const uint32_t n = width - x < STREAM_BLOCK
+						   ? width - x
+						   : STREAM_BLOCK;
+
+			k->stream_load(row0 + (size_t)x * 4, in0, n * 4);
+
+			switch (fmt) {
+			case FORMAT_UYVA:
+				k->alpha_row(in0, out, n);
+				k->stream_store(out,
+						plane + (size_t)y *
+								(dst_stride /
+								 2) +
+							x,
+						n);
+				[[fallthrough]];
+			case FORMAT_UYVY:
+				k->uyvy_row(in0, out, n, c);
+				k->stream_store(out, dst0 + (size_t)x * 2,
+						((n + 1) / 2) * 4);
+				break;
+
+			case FORMAT_BGRX:
+				k->bgrx_row(in0, out, n);
+				k->stream_store(out, dst0 + (size_t)x * 4,
+						(size_t)n * 4);
+				break;
+
+			case FORMAT_NV12:
+				if (y1 != y)
+					k->stream_load(row1 + (size_t)x * 4,
+						       in1, n * 4);
+				else
+					memcpy(in1, in0, (size_t)n * 4);
+
+				k->y_row(in0, out, n, c);
+				k->stream_store(out, dst0 + x, n);
+
+				if (y1 != y) {
+					k->y_row(in1, out, n, c);
+					k->stream_store(out, dst1 + x, n);
+				}
+
+				k->uv_row(in0, in1, out, n, c);
+				k->stream_store(out,
+						plane + (size_t)(y / 2) *
+								dst_stride +
+							x,
+						((n + 1) / 2) * 2);
+				break;
+			}
+		}
+	}
+
+	k->stream_fence();
+}
+
+void copy_frame_streaming(const kernels *k, const uint8_t *src,
+			  uint32_t src_linesize, uint8_t *dst,
+			  uint32_t dst_stride, uint32_t row_bytes,
+			  uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++)
+		k->stream_copy(src + (size_t)y * src_linesize,
+			       dst + (size_t)y * dst_stride, row_bytes);
+
+	k->stream_fence();
+}
+
+} // namespace NDI5Filter::Kernels
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pixel conversion kernels for the readback path
+//
+// Every kernel reads 8 bit RGBA rows (as mapped from a GS_RGBA staging surface)
+// and writes one of the NDI FourCC layouts. The SIMD variants are required to
+// match the scalar reference bit for bit, all the colour maths is done in
+// Q14 fixed point so that holds on every instruction set.
+
+namespace NDI5Filter::Kernels {
+
+enum isa : uint32_t {
+	ISA_SCALAR = 0,
+	ISA_SSE2,
+	ISA_SSSE3,
+	ISA_SSE41,
+	ISA_AVX2,
+	ISA_NEON,
+	ISA_COUNT,
+};
+
+enum format : uint32_t {
+	FORMAT_UYVY = 0, // packed 4:2:2
+	FORMAT_UYVA,     // packed 4:2:2 followed by an alpha plane
+	FORMAT_BGRX,     // packed 4:4:4, X = 255
+	FORMAT_NV12,     // Y plane followed by interleaved CbCr at half height
+};
+
+constexpr int COEFFICIENT_SHIFT = 14;
+
+// Y'CbCr = (c[0] * R + c[1] * G + c[2] * B + offset) >> COEFFICIENT_SHIFT
+struct coefficients {
+	int16_t y[4]; // 4th entry is always 0, handy for pmaddwd
+	int16_t u[4];
+	int16_t v[4];
+	int32_t y_offset; // includes the rounding term
+	int32_t c_offset;
+};
+
+typedef void (*row_fn)(const uint8_t *src, uint8_t *dst, uint32_t width,
+		       const coefficients *c);
+typedef void (*row2_fn)(const uint8_t *src0, const uint8_t *src1,
+			uint8_t *dst, uint32_t width, const coefficients *c);
+typedef void (*copy_fn)(const uint8_t *src, uint8_t *dst, uint32_t width);
+typedef void (*stream_fn)(const uint8_t *src, uint8_t *dst, size_t bytes);
+
+struct kernels {
+	const char *name;
+	isa id;
+
+	row_fn uyvy_row;   // width pixels -> (width + 1) / 2 UYVY pairs
+	row_fn y_row;      // width pixels -> width luma bytes
+	row2_fn uv_row;    // two rows -> (width + 1) / 2 CbCr pairs
+	copy_fn alpha_row; // width pixels -> width alpha bytes
+	copy_fn bgrx_row;  // width pixels -> width BGRX pixels
+
+	// Staging memory is often write-combined / uncached, these move bytes
+	// in and out of it without dragging the frame through the cache
+	stream_fn stream_load;  // uncached src -> cached scratch (movntdqa)
+	stream_fn stream_store; // cached scratch -> dst (movntdq)
+	stream_fn stream_copy;  // uncached src -> dst, both non-temporal
+	void (*stream_fence)(void);
+};
+
+// Float matrix shared with the GPU conversion effect, rows are
+// { R, G, B, offset } for Y, Cb and Cr, all normalised to 0..1
+void color_matrix(bool bt601, bool full_range, float out[3][4]);
+
+coefficients make_coefficients(bool bt601, bool full_range);
+
+// Best kernel set for this CPU, detected once
+const kernels *detect();
+
+// A specific kernel set, nullptr if this CPU (or build) cannot run it
+const kernels *get(isa id);
+
+// Bytes per row of the first plane of a converted frame
+uint32_t frame_stride(format fmt, uint32_t width);
+
+// Total bytes of a converted frame with the given first plane stride
+size_t frame_size(format fmt, uint32_t stride, uint32_t height);
+
+// Converts a whole RGBA frame, src_linesize is the staging surface pitch
+void convert_frame(const kernels *k, format fmt, const uint8_t *src,
+		   uint32_t src_linesize, uint8_t *dst, uint32_t dst_stride,
+		   uint32_t width, uint32_t height, const coefficients *c);
+
+// Single pass version of convert_frame -- every byte of src is read exactly
+// once with streaming loads into a small cache resident block, converted there
+// and written out with non-temporal stores
+void convert_frame_streaming(const kernels *k, format fmt, const uint8_t *src,
+			     uint32_t src_linesize, uint8_t *dst,
+			     uint32_t dst_stride, uint32_t width,
+			     uint32_t height, const coefficients *c);
+
+// Single pass row copy for outputs that need no conversion
+void copy_frame_streaming(const kernels *k, const uint8_t *src,
+			  uint32_t src_linesize, uint8_t *dst,
+			  uint32_t dst_stride, uint32_t row_bytes,
+			  uint32_t height);
+
+} // namespace NDI5Filter::Kernels
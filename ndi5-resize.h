@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+// What a rendition needs rebuilt for this frame's size, scale and format
+//
+// Textures, staging surfaces and frame buffers are allocated in multiples of
+// BUCKET pixels each way. A new size is sent from the buffers we have if it
+// fits them and they are no more than 1/SLACK too big (every frame stages the
+// whole texture). Only the first capture creates a sender -- NDI takes a new
+// size or FourCC on any frame, recreating the sender re-advertises the source
+// and every receiver drops and reconnects.
+
+namespace NDI5Filter::Resize {
+
+constexpr uint32_t BUCKET = 64;
+constexpr uint64_t SLACK = 4;
+
+inline uint32_t bucket(uint32_t size)
+{
+	return (size + BUCKET - 1) & ~(BUCKET - 1);
+}
+
+// Whether a width x height allocation can hold cx x cy without staging or
+// copying too much slack every frame
+inline bool reusable(uint32_t width, uint32_t height, uint32_t cx, uint32_t cy)
+{
+	if (cx > width || cy > height)
+		return false;
+
+	return (uint64_t)bucket(cx) * bucket(cy) * SLACK >=
+	       (uint64_t)width * height * (SLACK - 1);
+}
+
+// What the rendition was last built for
+struct built {
+	bool sender;    // a sender exists
+	bool allocated; // frame buffers exist
+	uint32_t format;
+	uint32_t width; // output
+	uint32_t height;
+	uint32_t alloc_width;
+	uint32_t alloc_height;
+	bool scaled; // has a scaled texture
+	uint32_t buffer_count;
+	bool threaded; // worker running
+};
+
+// What this frame asks for
+struct wanted {
+	bool resized; // the source or canvas changed
+	uint32_t format;
+	uint32_t width; // output
+	uint32_t height;
+	bool scaled; // packing it needs a scaled texture
+	uint32_t buffer_count;
+	bool threaded;
+};
+
+enum action {
+	KEEP,     // nothing changed
+	CREATE,   // first capture, everything built and the sender created
+	REFORMAT, // new output format, every buffer rebuilt
+	RELAYOUT, // fits the buffers, only the frame described to NDI changes
+	REBUILD,  // too big or small for the buffers, every buffer rebuilt
+	POOLS,    // frame buffer count or send mode, the pools rebuilt
+};
+
+// Every frame stages the whole texture, so the buffers may not be too big
+inline bool fits(const built &b, const wanted &w)
+{
+	if (!b.allocated ||
+	    !Resize::reusable(b.alloc_width, b.alloc_height, w.width, w.height))
+		return false;
+
+	// Packing a scaled output needs its scaled texture
+	return b.scaled == w.scaled;
+}
+
+inline action plan(const built &b, const wanted &w)
+{
+	if (!b.sender)
+		return CREATE;
+
+	if (b.format != w.format)
+		return REFORMAT;
+
+	if (w.resized || b.width != w.width || b.height != w.height)
+		return Resize::fits(b, w) ? RELAYOUT : REBUILD;
+
+	if (b.buffer_count != w.buffer_count || b.threaded != w.threaded)
+		return POOLS;
+
+	return KEEP;
+}
+
+} // namespace NDI5Filter::Resize
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "inc/Processing.NDI.Lib.h"
+
+// Every NDI sender the filter makes -- a rendition's first, a rename's and a
+// tile's. Video is never clocked, OBS paces the frames.
+
+namespace NDI5Filter::Sender {
+
+inline NDIlib_send_instance_t create(const NDIlib_v5 *lib, const char *name)
+{
+	NDIlib_send_create_t desc;
+	desc.p_ndi_name = name;
+	desc.clock_video = false;
+
+	return lib->send_create(&desc);
+}
+
+} // namespace NDI5Filter::Sender
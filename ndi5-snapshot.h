@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// Latest immutable value, handed between threads
+//
+// One thread publishes a value it built off to the side, any other thread
+// takes the latest without either side ever blocking on the other. A value is
+// never changed once published -- readers keep theirs for as long as they
+// hold it, and it is freed by whoever lets go of it last.
+
+namespace NDI5Filter {
+
+template<typename T> class snapshot {
+public:
+	void publish(std::shared_ptr<const T> value)
+	{
+		latest_.store(std::move(value));
+	}
+
+	std::shared_ptr<const T> load() const { return latest_.load(); }
+
+	// Moves current on to the latest, true if there was a newer one
+	bool take(std::shared_ptr<const T> &current) const
+	{
+		auto latest = latest_.load();
+
+		if (latest == current)
+			return false;
+
+		current = std::move(latest);
+		return true;
+	}
+
+private:
+	std::atomic<std::shared_ptr<const T>> latest_;
+};
+
+} // namespace NDI5Filter
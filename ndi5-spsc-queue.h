@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded single producer / single consumer ring
+//
+// One thread may push and one other thread may pop, neither ever blocks or
+// takes a lock. Capacity is the number of items that can be queued at once.
+
+namespace NDI5Filter {
+
+template<typename T, size_t Capacity> class spsc_queue {
+public:
+	bool push(const T &item)
+	{
+		const size_t head = head_.load(std::memory_order_relaxed);
+		const size_t next = increment(head);
+
+		if (next == tail_.load(std::memory_order_acquire))
+			return false; // full
+
+		items_[head] = item;
+		head_.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+
+		if (tail == head_.load(std::memory_order_acquire))
+			return false; // empty
+
+		item = items_[tail];
+		tail_.store(increment(tail), std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return tail_.load(std::memory_order_acquire) ==
+		       head_.load(std::memory_order_acquire);
+	}
+
+	size_t size() const
+	{
+		const size_t head = head_.load(std::memory_order_acquire);
+		const size_t tail = tail_.load(std::memory_order_acquire);
+		return head >= tail ? head - tail : head + Slots - tail;
+	}
+
+private:
+	static constexpr size_t Slots = Capacity + 1;
+
+	static size_t increment(size_t index)
+	{
+		return index + 1 == Slots ? 0 : index + 1;
+	}
+
+	// Producer and consumer indexes on their own cache lines
+	alignas(64) std::atomic<size_t> head_{0};
+	alignas(64) std::atomic<size_t> tail_{0};
+	alignas(64) T items_[Slots];
+};
+
+} // namespace NDI5Filter
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <stdint.h>
+
+// Adaptive staging depth for one rendition
+//
+// Fed the time of every staging surface map. Maps slower than the threshold
+// count as stalls. Once a window of WINDOW maps is full, the depth grows when
+// more than STALL_PERCENT of it stalled and shrinks after CALM_WINDOWS windows
+// in a row without a single stall, always within min and max. Not adaptive,
+// the depth is the fixed one. Every map also lands in a histogram the
+// properties view shows.
+
+namespace NDI5Filter::Depth {
+
+constexpr uint32_t WINDOW = 120;
+constexpr uint32_t STALL_PERCENT = 2;
+constexpr uint32_t CALM_WINDOWS = 5;
+
+// Histogram bucket upper bounds in microseconds, the last bucket takes
+// everything slower
+constexpr uint32_t HISTOGRAM_BOUNDS_US[] = {100,  250,  500, 1000,
+					    2000, 4000, 8000};
+constexpr int HISTOGRAM_BUCKETS = std::size(HISTOGRAM_BOUNDS_US) + 1;
+
+struct settings {
+	bool adaptive;     // adapt at all, or keep to fixed
+	uint32_t fixed;    // the depth when not adaptive, where adapting starts
+	uint32_t min;      // adaptive bounds
+	uint32_t max;
+	uint64_t stall_ns; // maps slower than this stalled
+};
+
+enum change { KEPT, GREW, SHRANK };
+
+inline int bucket(uint64_t map_ns)
+{
+	const uint64_t map_us = map_ns / 1000;
+
+	int i = 0;
+	while (i < HISTOGRAM_BUCKETS - 1 && map_us >= HISTOGRAM_BOUNDS_US[i])
+		i++;
+	return i;
+}
+
+class state {
+public:
+	// Back to the fixed depth, a new window and no calm behind it
+	void reset(const settings &s)
+	{
+		depth_ = s.fixed;
+		maps_ = 0;
+		stalls_ = 0;
+		calm_ = 0;
+	}
+
+	// One timed map, true if it stalled
+	bool record(uint64_t map_ns, const settings &s)
+	{
+		histogram_[Depth::bucket(map_ns)]++;
+
+		const bool stalled = map_ns > s.stall_ns;
+
+		maps_++;
+		if (stalled)
+			stalls_++;
+		return stalled;
+	}
+
+	// Once per frame, moves the depth if a window is full
+	change adapt(const settings &s)
+	{
+		if (!s.adaptive) {
+			depth_ = s.fixed;
+			return KEPT;
+		}
+
+		depth_ = std::clamp(depth_, s.min, s.max);
+
+		if (maps_ < WINDOW)
+			return KEPT;
+
+		const bool stalling = stalls_ * 100 > maps_ * STALL_PERCENT;
+
+		calm_ = stalls_ ? 0 : calm_ + 1;
+		maps_ = 0;
+		stalls_ = 0;
+
+		if (stalling && depth_ < s.max) {
+			depth_++;
+			return GREW;
+		}
+
+		if (calm_ >= CALM_WINDOWS && depth_ > s.min) {
+			depth_--;
+			calm_ = 0;
+			return SHRANK;
+		}
+
+		return KEPT;
+	}
+
+	uint32_t depth() const { return depth_; }
+
+	// The window filling up, closed windows start over
+	uint32_t maps() const { return maps_; }
+	uint32_t stalls() const { return stalls_; }
+
+	// Maps in a bucket since the rendition was made, safe from any thread
+	uint64_t histogram(int bucket) const { return histogram_[bucket]; }
+
+private:
+	uint32_t depth_ = 1;
+	uint32_t maps_ = 0;   // timed in the current window
+	uint32_t stalls_ = 0; // of those, how many went over the threshold
+	uint32_t calm_ = 0;   // windows in a row without a stall
+	std::atomic<uint64_t> histogram_[HISTOGRAM_BUCKETS] = {};
+};
+
+} // namespace NDI5Filter::Depth
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+// Off air throttling for one sender
+//
+// Fed the receivers' tally once per frame. Off air the frame rate drops at
+// once, changing it back costs nothing. The size only drops once off air has
+// held for hold frames -- a new size rebuilds every buffer, and a mixer cutting
+// back and forth would otherwise rebuild them on every cut. Back on program or
+// preview both return at once.
+
+namespace NDI5Filter::Tally {
+
+struct settings {
+	bool throttle;  // off air throttling on at all
+	uint32_t rate;  // frame rate divided by this off air
+	uint32_t scale; // width and height divided by this off air
+	uint32_t hold;  // frames off air before the size drops
+};
+
+class state {
+public:
+	void update(bool on_program, bool on_preview, const settings &s)
+	{
+		off_air_ = s.throttle && !on_program && !on_preview;
+
+		if (!off_air_) {
+			frames_ = 0;
+			rate_ = 1;
+			scale_ = 1;
+			return;
+		}
+
+		if (frames_ <= s.hold)
+			frames_++;
+
+		rate_ = s.rate;
+		scale_ = frames_ > s.hold ? s.scale : 1;
+	}
+
+	// Nobody has us on program or preview, and throttling is on
+	bool off_air() const { return off_air_; }
+
+	// Divisors for this frame, 1 on air
+	uint32_t rate() const { return rate_; }
+	uint32_t scale() const { return scale_; }
+
+private:
+	bool off_air_ = false;
+	uint32_t frames_ = 0; // off air in a row, stops counting past hold
+	uint32_t rate_ = 1;
+	uint32_t scale_ = 1;
+};
+
+} // namespace NDI5Filter::Tally
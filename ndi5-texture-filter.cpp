@@ -5,293 +5,3211 @@
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE(OBS_PLUGIN, OBS_PLUGIN_LANG)
 
-// Use the current frame to stage the next frames texture
-// If defined this will force the renderer to stage the next calls ndi data with the texture
-// just rendered in the current frame -- double buffering regardless of how many buffers we
-// set
-// If this is undefined, we fill up the buffers and then frames start outputting
-#define USE_CURRENT_FRAME
-#undef USE_CURRENT_FRAME
+const NDIlib_v5 *ndi5_lib = nullptr;
+
+// Frame buffers of every filter, created in obs_module_load
+std::unique_ptr<NDI5Filter::Buffers::pool> ndi5_frame_pool;
+
+namespace NDI5Filter {
+
+static const char *filter_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text(OBS_SETTING_UI_FILTER_NAME);
+}
+
+static bool filter_update_sender_name(obs_properties_t *, obs_property_t *,
+				      void *data)
+{
+	auto filter = (struct filter *)data;
+
+	obs_data_t *settings = obs_source_get_settings(filter->context);
+	filter_update(filter, settings);
+	obs_data_release(settings);
+	return true;
+}
+
+// Returning true has OBS rebuild the properties, refreshing the memory line
+static bool filter_refresh_properties(obs_properties_t *, obs_property_t *,
+				      void *)
+{
+	return true;
+}
+
+// The frame buffer cap covers every filter, so it lives in the module's own
+// config rather than any one filter's settings
+static void save_frame_pool_cap(uint64_t cap_mb)
+{
+	char *dir = obs_module_config_path("");
+	os_mkdirs(dir);
+	bfree(dir);
+
+	obs_data_t *module_config = obs_data_create();
+	obs_data_set_int(module_config, OBS_SETTING_UI_BUFFER_POOL_CAP,
+			 (long long)cap_mb);
+
+	char *path = obs_module_config_path(OBS_PLUGIN_CONFIG_FILE);
+	obs_data_save_json_safe(module_config, path, "tmp", "bak");
+	bfree(path);
+
+	obs_data_release(module_config);
+}
+
+static bool filter_update_frame_pool_cap(obs_properties_t *, obs_property_t *,
+					 obs_data_t *settings)
+{
+	const uint64_t cap_mb = (uint64_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_BUFFER_POOL_CAP);
+
+	if (cap_mb * 1048576 == ndi5_frame_pool->get_stats().cap)
+		return false;
+
+	ndi5_frame_pool->set_cap(cap_mb * 1048576);
+	save_frame_pool_cap(cap_mb);
+
+	// Kept in the module's config alone, the filter's settings only show
+	// it -- nothing is written to the scene collection
+	obs_data_set_default_int(settings, OBS_SETTING_UI_BUFFER_POOL_CAP,
+				 (long long)cap_mb);
+	obs_data_unset_user_value(settings, OBS_SETTING_UI_BUFFER_POOL_CAP);
+
+	info("frame buffer cap for all filters set to %llu MB",
+	     (unsigned long long)cap_mb);
+
+	return false;
+}
+
+// Settings and info lines of a proxy are the primary's key with the proxy's
+// index appended
+static std::string rendition_key(const char *name, uint32_t index)
+{
+	if (!index)
+		return name;
+
+	return std::string(name) + "." + std::to_string(index);
+}
+
+// What a rendition's sender is called, a proxy left unnamed is named after
+// the primary
+static std::string rendition_name(obs_data_t *settings, uint32_t index)
+{
+	const char *primary =
+		obs_data_get_string(settings, OBS_SETTING_UI_SENDER_NAME);
+
+	if (!index)
+		return primary;
+
+	auto key = rendition_key(OBS_SETTING_UI_SENDER_NAME, index);
+	const char *name = obs_data_get_string(settings, key.c_str());
+
+	if (name && *name)
+		return name;
+
+	char derived[256];
+	snprintf(derived, sizeof(derived),
+		 obs_module_text(OBS_SETTING_DEFAULT_RENDITION_NAME), primary,
+		 index);
+
+	return derived;
+}
+
+// Bytes currently held by a rendition's render targets, staging ring and
+// frame buffer pool
+static void pool_memory(void *data, uint64_t *textures, uint64_t *staging,
+			uint64_t *buffers)
+{
+	auto rendition = (struct rendition *)data;
+
+	const uint64_t texture_bytes = (uint64_t)rendition->texture_width *
+				       rendition->alloc_height * 4;
+
+	*textures = rendition->render_texture ? texture_bytes : 0;
+	*staging = texture_bytes * rendition->allocated_staging_count;
+	*buffers = rendition->frame_buffers.bytes();
+
+	if (rendition->scaled_texture)
+		*textures += (uint64_t)rendition->alloc_width *
+			     rendition->alloc_height * 4;
+}
+
+// Average staged to sent latency, in frames and milliseconds
+static void send_latency(void *data, double *frames, double *ms, uint32_t *max)
+{
+	auto rendition = (struct rendition *)data;
+
+	const uint64_t samples = rendition->latency_samples;
+
+	*frames = samples ? (double)rendition->latency_frames / samples : 0.0;
+	*ms = samples ? (double)rendition->latency_ns / samples / 1000000.0
+		      : 0.0;
+	*max = rendition->latency_max;
+}
+
+static void add_output_sizes(obs_properties_t *props, const char *key)
+{
+	auto output_size = obs_properties_add_list(
+		props, key, obs_module_text(OBS_SETTING_UI_OUTPUT_SIZE),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		output_size, obs_module_text(OBS_SETTING_UI_OUTPUT_SIZE_SOURCE),
+		NDI_OUTPUT_SIZE_SOURCE);
+
+	for (auto height : NDI_OUTPUT_HEIGHTS) {
+		char name[64];
+		snprintf(name, sizeof(name),
+			 obs_module_text(OBS_SETTING_UI_OUTPUT_SIZE_HEIGHT),
+			 height);
+		obs_property_list_add_int(output_size, name, height);
+	}
+}
+
+// Staging, map time, latency, receiver, tally and render thread lines of one
+// rendition, sizes from the status the graphics thread last published
+static void add_rendition_status(obs_properties_t *props, void *data,
+				 const struct rendition_status &shown)
+{
+	auto rendition = (struct rendition *)data;
+
+	auto add_line = [props, rendition](const char *name, const char *text) {
+		obs_properties_add_text(
+			props, rendition_key(name, rendition->index).c_str(),
+			text, OBS_TEXT_INFO);
+	};
+
+	char status[256];
+	snprintf(status, sizeof(status),
+		 obs_module_text(OBS_SETTING_UI_STAGING_STATUS),
+		 shown.staging_depth, shown.staging_count);
+
+	add_line(OBS_SETTING_UI_STAGING_STATUS, status);
+
+	// Map times, one "<bound us: count" per bucket
+	std::string histogram = obs_module_text(OBS_SETTING_UI_MAP_HISTOGRAM);
+
+	for (int i = 0; i < Depth::HISTOGRAM_BUCKETS; i++) {
+		if (i < Depth::HISTOGRAM_BUCKETS - 1)
+			histogram += "  <" + std::to_string(
+				Depth::HISTOGRAM_BOUNDS_US[i]);
+		else
+			histogram += "  >=" + std::to_string(
+				Depth::HISTOGRAM_BOUNDS_US[i - 1]);
+
+		histogram += "us: " +
+			     std::to_string(rendition->staging.histogram(i));
+	}
+
+	add_line(OBS_SETTING_UI_MAP_HISTOGRAM, histogram.c_str());
+
+	double frames, ms;
+	uint32_t max;
+	send_latency(rendition, &frames, &ms, &max);
+
+	char latency[256];
+	snprintf(latency, sizeof(latency),
+		 obs_module_text(OBS_SETTING_UI_LATENCY), frames, ms, max);
+
+	add_line(OBS_SETTING_UI_LATENCY, latency);
+
+	char buffer_status[256];
+	snprintf(buffer_status, sizeof(buffer_status),
+		 obs_module_text(OBS_SETTING_UI_BUFFER_STATUS),
+		 rendition->frame_buffers.bytes() / 1048576.0,
+		 (unsigned long long)rendition->frames_unbuffered.load());
+
+	add_line(OBS_SETTING_UI_BUFFER_STATUS, buffer_status);
+
+	char connections[256];
+	snprintf(connections, sizeof(connections),
+		 obs_module_text(OBS_SETTING_UI_CONNECTIONS),
+		 rendition->connections.load(),
+		 (unsigned long long)rendition->frames_idle.load());
+
+	add_line(OBS_SETTING_UI_CONNECTIONS, connections);
+
+	const char *tally =
+		rendition->on_program   ? OBS_SETTING_UI_TALLY_PROGRAM
+		: rendition->on_preview ? OBS_SETTING_UI_TALLY_PREVIEW
+					: OBS_SETTING_UI_TALLY_OFF_AIR;
+
+	char tally_status[256];
+	snprintf(tally_status, sizeof(tally_status),
+		 obs_module_text(OBS_SETTING_UI_TALLY_STATUS),
+		 obs_module_text(tally), shown.width, shown.height,
+		 (double)shown.frame_rate_N / shown.frame_rate_D,
+		 (unsigned long long)rendition->frames_decimated.load());
+
+	add_line(OBS_SETTING_UI_TALLY_STATUS, tally_status);
+
+	const uint64_t readbacks = rendition->readbacks;
+
+	char timing[256];
+	snprintf(timing, sizeof(timing),
+		 obs_module_text(OBS_SETTING_UI_RENDITION_STATUS),
+		 readbacks ? rendition->readback_ns / readbacks / 1000000.0
+			   : 0.0,
+		 (unsigned long long)readbacks);
+
+	add_line(OBS_SETTING_UI_RENDITION_STATUS, timing);
+}
+
+static obs_properties_t *filter_properties(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	auto props = obs_properties_create();
+
+	obs_properties_set_flags(props, OBS_PROPERTIES_DEFER_UPDATE);
+
+	obs_properties_add_text(props, OBS_SETTING_UI_SENDER_NAME,
+				obs_module_text(OBS_SETTING_UI_SENDER_NAME),
+				OBS_TEXT_DEFAULT);
+
+	obs_properties_add_button(props, OBS_SETTING_UI_BUTTON_TITLE,
+				  obs_module_text(OBS_SETTING_UI_BUTTON_TITLE),
+				  filter_update_sender_name);
+
+	auto capture_mode = obs_properties_add_list(
+		props, OBS_SETTING_UI_CAPTURE_MODE,
+		obs_module_text(OBS_SETTING_UI_CAPTURE_MODE),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(capture_mode,
+				  obs_module_text(OBS_SETTING_UI_CAPTURE_AUTO),
+				  CAPTURE_MODE_AUTO);
+	obs_property_list_add_int(
+		capture_mode, obs_module_text(OBS_SETTING_UI_CAPTURE_FILTER),
+		CAPTURE_MODE_FILTER);
+	obs_property_list_add_int(
+		capture_mode, obs_module_text(OBS_SETTING_UI_CAPTURE_PARENT),
+		CAPTURE_MODE_PARENT);
+
+	auto output_format = obs_properties_add_list(
+		props, OBS_SETTING_UI_OUTPUT_FORMAT,
+		obs_module_text(OBS_SETTING_UI_OUTPUT_FORMAT),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(output_format,
+				  obs_module_text(OBS_SETTING_UI_FORMAT_RGBA),
+				  OUTPUT_FORMAT_RGBA);
+	obs_property_list_add_int(
+		output_format, obs_module_text(OBS_SETTING_UI_FORMAT_UYVY_GPU),
+		OUTPUT_FORMAT_UYVY_GPU);
+	obs_property_list_add_int(
+		output_format, obs_module_text(OBS_SETTING_UI_FORMAT_UYVY_CPU),
+		OUTPUT_FORMAT_UYVY_CPU);
+	obs_property_list_add_int(
+		output_format, obs_module_text(OBS_SETTING_UI_FORMAT_UYVA_CPU),
+		OUTPUT_FORMAT_UYVA_CPU);
+	obs_property_list_add_int(
+		output_format, obs_module_text(OBS_SETTING_UI_FORMAT_BGRX_CPU),
+		OUTPUT_FORMAT_BGRX_CPU);
+	obs_property_list_add_int(
+		output_format, obs_module_text(OBS_SETTING_UI_FORMAT_NV12_CPU),
+		OUTPUT_FORMAT_NV12_CPU);
+
+	add_output_sizes(props, OBS_SETTING_UI_OUTPUT_SIZE);
+
+	auto scaler = obs_properties_add_list(
+		props, OBS_SETTING_UI_SCALER,
+		obs_module_text(OBS_SETTING_UI_SCALER), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		scaler, obs_module_text(OBS_SETTING_UI_SCALER_BILINEAR),
+		SCALER_BILINEAR);
+	obs_property_list_add_int(scaler,
+				  obs_module_text(OBS_SETTING_UI_SCALER_BICUBIC),
+				  SCALER_BICUBIC);
+	obs_property_list_add_int(scaler,
+				  obs_module_text(OBS_SETTING_UI_SCALER_LANCZOS),
+				  SCALER_LANCZOS);
+	obs_property_list_add_int(scaler,
+				  obs_module_text(OBS_SETTING_UI_SCALER_AREA),
+				  SCALER_AREA);
+
+	// Fixed canvas -- the source is fitted into it, never resized to it
+	auto canvas = obs_properties_create();
+
+	obs_properties_add_int(canvas, OBS_SETTING_UI_CANVAS_WIDTH,
+			       obs_module_text(OBS_SETTING_UI_CANVAS_WIDTH),
+			       NDI_CANVAS_SIZE_MIN, NDI_CANVAS_SIZE_MAX, 2);
+	obs_properties_add_int(canvas, OBS_SETTING_UI_CANVAS_HEIGHT,
+			       obs_module_text(OBS_SETTING_UI_CANVAS_HEIGHT),
+			       NDI_CANVAS_SIZE_MIN, NDI_CANVAS_SIZE_MAX, 2);
+
+	obs_properties_add_group(props, OBS_SETTING_UI_CANVAS,
+				 obs_module_text(OBS_SETTING_UI_CANVAS),
+				 OBS_GROUP_CHECKABLE, canvas);
+
+	obs_properties_add_int(props, OBS_SETTING_UI_RESIZE_HOLD,
+			       obs_module_text(OBS_SETTING_UI_RESIZE_HOLD), 0,
+			       NDI_RESIZE_HOLD_MAX, 1);
+
+	obs_properties_add_bool(
+		props, OBS_SETTING_UI_STREAMING_READBACK,
+		obs_module_text(OBS_SETTING_UI_STREAMING_READBACK));
+
+	obs_properties_add_bool(props, OBS_SETTING_UI_ZERO_COPY,
+				obs_module_text(OBS_SETTING_UI_ZERO_COPY));
+
+	auto color_matrix = obs_properties_add_list(
+		props, OBS_SETTING_UI_COLOR_MATRIX,
+		obs_module_text(OBS_SETTING_UI_COLOR_MATRIX),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		color_matrix, obs_module_text(OBS_SETTING_UI_COLOR_MATRIX_709),
+		COLOR_MATRIX_709);
+	obs_property_list_add_int(
+		color_matrix, obs_module_text(OBS_SETTING_UI_COLOR_MATRIX_601),
+		COLOR_MATRIX_601);
+
+	auto color_range = obs_properties_add_list(
+		props, OBS_SETTING_UI_COLOR_RANGE,
+		obs_module_text(OBS_SETTING_UI_COLOR_RANGE),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		color_range, obs_module_text(OBS_SETTING_UI_COLOR_RANGE_PARTIAL),
+		COLOR_RANGE_PARTIAL);
+	obs_property_list_add_int(
+		color_range, obs_module_text(OBS_SETTING_UI_COLOR_RANGE_FULL),
+		COLOR_RANGE_FULL);
+
+	obs_properties_add_bool(props, OBS_SETTING_UI_THREADED_SEND,
+				obs_module_text(OBS_SETTING_UI_THREADED_SEND));
+
+	auto backpressure = obs_properties_add_list(
+		props, OBS_SETTING_UI_BACKPRESSURE,
+		obs_module_text(OBS_SETTING_UI_BACKPRESSURE),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		backpressure, obs_module_text(OBS_SETTING_UI_BACKPRESSURE_OLDEST),
+		BACKPRESSURE_DROP_OLDEST);
+	obs_property_list_add_int(
+		backpressure, obs_module_text(OBS_SETTING_UI_BACKPRESSURE_NEWEST),
+		BACKPRESSURE_DROP_NEWEST);
+	obs_property_list_add_int(
+		backpressure, obs_module_text(OBS_SETTING_UI_BACKPRESSURE_BLOCK),
+		BACKPRESSURE_BLOCK);
+
+	obs_properties_add_int(props, OBS_SETTING_UI_STAGING_DEPTH,
+			       obs_module_text(OBS_SETTING_UI_STAGING_DEPTH),
+			       NDI_STAGING_DEPTH_MIN, NDI_STAGING_DEPTH_MAX, 1);
+	obs_properties_add_bool(props, OBS_SETTING_UI_ADAPTIVE_STAGING,
+				obs_module_text(OBS_SETTING_UI_ADAPTIVE_STAGING));
+	obs_properties_add_int(props, OBS_SETTING_UI_STAGING_DEPTH_MIN,
+			       obs_module_text(OBS_SETTING_UI_STAGING_DEPTH_MIN),
+			       NDI_STAGING_DEPTH_MIN, NDI_STAGING_DEPTH_MAX, 1);
+	obs_properties_add_int(props, OBS_SETTING_UI_STAGING_DEPTH_MAX,
+			       obs_module_text(OBS_SETTING_UI_STAGING_DEPTH_MAX),
+			       NDI_STAGING_DEPTH_MIN, NDI_STAGING_DEPTH_MAX, 1);
+
+	auto stall_threshold = obs_properties_add_int(
+		props, OBS_SETTING_UI_STALL_THRESHOLD,
+		obs_module_text(OBS_SETTING_UI_STALL_THRESHOLD), 50, 20000, 50);
+	obs_property_int_set_suffix(stall_threshold, " us");
+
+	obs_properties_add_bool(props, OBS_SETTING_UI_LOW_LATENCY,
+				obs_module_text(OBS_SETTING_UI_LOW_LATENCY));
+
+	obs_properties_add_int(
+		props, OBS_SETTING_UI_FRAME_BUFFER_COUNT,
+		obs_module_text(OBS_SETTING_UI_FRAME_BUFFER_COUNT),
+		NDI_FRAME_BUFFER_COUNT_MIN, NDI_BUFFER_COUNT, 1);
+
+	// Module wide -- shown as whatever the pool has now, whichever filter
+	// it was set from. Only a default, which is never saved.
+	if (filter) {
+		obs_data_t *settings = obs_source_get_settings(filter->context);
+		obs_data_set_default_int(
+			settings, OBS_SETTING_UI_BUFFER_POOL_CAP,
+			ndi5_frame_pool->get_stats().cap / 1048576);
+		obs_data_release(settings);
+	}
+
+	auto pool_cap = obs_properties_add_int(
+		props, OBS_SETTING_UI_BUFFER_POOL_CAP,
+		obs_module_text(OBS_SETTING_UI_BUFFER_POOL_CAP), 0,
+		NDI_FRAME_POOL_CAP_MAX_MB, 64);
+
+	obs_property_set_modified_callback(pool_cap,
+					   filter_update_frame_pool_cap);
+
+	obs_properties_add_bool(props, OBS_SETTING_UI_IDLE_UNWATCHED,
+				obs_module_text(OBS_SETTING_UI_IDLE_UNWATCHED));
+
+	auto frame_rate = obs_properties_add_list(
+		props, OBS_SETTING_UI_FRAME_RATE,
+		obs_module_text(OBS_SETTING_UI_FRAME_RATE), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT);
+
+	obs_property_list_add_int(
+		frame_rate, obs_module_text(OBS_SETTING_UI_FRAME_RATE_MATCH),
+		NDI_FRAME_RATE_MATCH);
+
+	for (auto every : NDI_FRAME_RATE_EVERY) {
+		char name[64];
+		snprintf(name, sizeof(name),
+			 obs_module_text(OBS_SETTING_UI_FRAME_RATE_EVERY), every);
+		obs_property_list_add_int(frame_rate, name, -every);
+	}
+
+	for (auto fps : NDI_FRAME_RATE_TARGETS) {
+		char name[64];
+		snprintf(name, sizeof(name),
+			 obs_module_text(OBS_SETTING_UI_FRAME_RATE_FPS), fps);
+		obs_property_list_add_int(frame_rate, name, fps);
+	}
+
+	obs_properties_add_bool(props, OBS_SETTING_UI_TALLY_THROTTLE,
+				obs_module_text(OBS_SETTING_UI_TALLY_THROTTLE));
+	obs_properties_add_int(props, OBS_SETTING_UI_TALLY_RATE,
+			       obs_module_text(OBS_SETTING_UI_TALLY_RATE), 1,
+			       NDI_TALLY_RATE_MAX, 1);
+	obs_properties_add_int(props, OBS_SETTING_UI_TALLY_SCALE,
+			       obs_module_text(OBS_SETTING_UI_TALLY_SCALE), 1,
+			       NDI_TALLY_SCALE_MAX, 1);
+
+	// Proxies -- extra senders scaled from the same capture
+	for (uint32_t i = 1; i < NDI_RENDITION_COUNT; i++) {
+		auto group = obs_properties_create();
+
+		obs_properties_add_text(
+			group,
+			rendition_key(OBS_SETTING_UI_SENDER_NAME, i).c_str(),
+			obs_module_text(OBS_SETTING_UI_SENDER_NAME),
+			OBS_TEXT_DEFAULT);
+
+		add_output_sizes(group,
+				 rendition_key(OBS_SETTING_UI_OUTPUT_SIZE, i)
+					 .c_str());
+
+		auto shown = filter ? filter->renditions[i].status.load()
+				    : nullptr;
+
+		if (shown && shown->sender_created)
+			add_rendition_status(group, &filter->renditions[i],
+					     *shown);
+
+		char title[64];
+		snprintf(title, sizeof(title),
+			 obs_module_text(OBS_SETTING_UI_RENDITION), i);
+
+		obs_properties_add_group(
+			props,
+			rendition_key(OBS_SETTING_UI_RENDITION, i).c_str(),
+			title, OBS_GROUP_CHECKABLE, group);
+	}
+
+	// Video wall -- crops of the primary, each sent by its own sender
+	auto tiles = obs_properties_create();
+
+	obs_properties_add_editable_list(
+		tiles, OBS_SETTING_UI_TILE_LIST,
+		obs_module_text(OBS_SETTING_UI_TILE_LIST),
+		OBS_EDITABLE_LIST_TYPE_STRINGS, NULL, NULL);
+
+	auto primary = filter ? filter->renditions[0].status.load() : nullptr;
+
+	if (primary && primary->tile_count) {
+		char status[256];
+		snprintf(status, sizeof(status),
+			 obs_module_text(OBS_SETTING_UI_TILE_STATUS),
+			 primary->tile_count,
+			 filter->renditions[0].tile_connections.load());
+
+		obs_properties_add_text(tiles, OBS_SETTING_UI_TILE_STATUS,
+					status, OBS_TEXT_INFO);
+	}
+
+	obs_properties_add_group(props, OBS_SETTING_UI_TILES,
+				 obs_module_text(OBS_SETTING_UI_TILES),
+				 OBS_GROUP_CHECKABLE, tiles);
+
+	if (filter) {
+		uint64_t textures = filter->capture_bytes, staging = 0,
+			 buffers = 0;
+
+		for (auto &rendition : filter->renditions) {
+			auto shown = rendition.status.load();
+
+			if (shown) {
+				textures += shown->texture_bytes;
+				staging += shown->staging_bytes;
+			}
+
+			buffers += rendition.frame_buffers.bytes();
+		}
+
+		char usage[256];
+		snprintf(usage, sizeof(usage),
+			 obs_module_text(OBS_SETTING_UI_MEMORY_USAGE),
+			 textures / 1048576.0, staging / 1048576.0,
+			 buffers / 1048576.0);
+
+		obs_properties_add_text(props, OBS_SETTING_UI_MEMORY_USAGE,
+					usage, OBS_TEXT_INFO);
+
+		auto pool = ndi5_frame_pool->get_stats();
+
+		char cap[64];
+		if (pool.cap)
+			snprintf(cap, sizeof(cap), "%.0f MB",
+				 pool.cap / 1048576.0);
+		else
+			snprintf(cap, sizeof(cap), "%s",
+				 obs_module_text(
+					 OBS_SETTING_UI_BUFFER_POOL_NO_CAP));
+
+		char buffer_pool[256];
+		snprintf(buffer_pool, sizeof(buffer_pool),
+			 obs_module_text(OBS_SETTING_UI_BUFFER_POOL_STATUS),
+			 pool.bytes / 1048576.0, cap,
+			 pool.huge_bytes / 1048576.0,
+			 (unsigned long long)pool.allocations,
+			 (unsigned long long)pool.reuses,
+			 (unsigned long long)pool.refusals);
+
+		obs_properties_add_text(props,
+					OBS_SETTING_UI_BUFFER_POOL_STATUS,
+					buffer_pool, OBS_TEXT_INFO);
+
+		char resizes[256];
+		snprintf(resizes, sizeof(resizes),
+			 obs_module_text(OBS_SETTING_UI_RESIZE_STATUS),
+			 (unsigned long long)filter->resizes_rebuilt.load(),
+			 (unsigned long long)filter->resizes_reused.load(),
+			 (unsigned long long)filter->resizes_ignored.load(),
+			 (unsigned long long)filter->resize_frames_held.load());
+
+		obs_properties_add_text(props, OBS_SETTING_UI_RESIZE_STATUS,
+					resizes, OBS_TEXT_INFO);
+
+		if (primary)
+			add_rendition_status(props, &filter->renditions[0],
+					     *primary);
+	}
+
+	obs_properties_add_button(
+		props, OBS_SETTING_UI_MEMORY_REFRESH,
+		obs_module_text(OBS_SETTING_UI_MEMORY_REFRESH),
+		filter_refresh_properties);
+
+	return props;
+}
+
+static void filter_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_string(
+		defaults, OBS_SETTING_UI_SENDER_NAME,
+		obs_module_text(OBS_SETTING_DEFAULT_SENDER_NAME));
+
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_CAPTURE_MODE,
+				 CAPTURE_MODE_AUTO);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_OUTPUT_FORMAT,
+				 OUTPUT_FORMAT_RGBA);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_OUTPUT_SIZE,
+				 NDI_OUTPUT_SIZE_SOURCE);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_SCALER,
+				 SCALER_BICUBIC);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_STREAMING_READBACK,
+				  true);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_ZERO_COPY, false);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_COLOR_MATRIX,
+				 COLOR_MATRIX_709);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_COLOR_RANGE,
+				 COLOR_RANGE_PARTIAL);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_THREADED_SEND, true);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_BACKPRESSURE,
+				 BACKPRESSURE_DROP_OLDEST);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_STAGING_DEPTH,
+				 NDI_STAGING_DEPTH_DEFAULT);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_ADAPTIVE_STAGING,
+				  true);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_STAGING_DEPTH_MIN,
+				 NDI_STAGING_DEPTH_MIN);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_STAGING_DEPTH_MAX,
+				 NDI_STAGING_DEPTH_MAX_DEFAULT);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_STALL_THRESHOLD,
+				 NDI_STALL_THRESHOLD_US_DEFAULT);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_LOW_LATENCY, false);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_FRAME_BUFFER_COUNT,
+				 NDI_FRAME_BUFFER_COUNT_DEFAULT);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_IDLE_UNWATCHED, true);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_FRAME_RATE,
+				 NDI_FRAME_RATE_MATCH);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_TALLY_THROTTLE,
+				  false);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_TALLY_RATE,
+				 NDI_TALLY_RATE_DEFAULT);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_TALLY_SCALE,
+				 NDI_TALLY_SCALE_DEFAULT);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_TILES, false);
+	obs_data_set_default_bool(defaults, OBS_SETTING_UI_CANVAS, false);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_CANVAS_WIDTH,
+				 NDI_CANVAS_WIDTH_DEFAULT);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_CANVAS_HEIGHT,
+				 NDI_CANVAS_HEIGHT_DEFAULT);
+	obs_data_set_default_int(defaults, OBS_SETTING_UI_RESIZE_HOLD,
+				 NDI_RESIZE_HOLD_DEFAULT);
+
+	// Proxies are off, and named after the primary unless given a name
+	for (uint32_t i = 1; i < NDI_RENDITION_COUNT; i++) {
+		obs_data_set_default_bool(
+			defaults,
+			rendition_key(OBS_SETTING_UI_RENDITION, i).c_str(),
+			false);
+		obs_data_set_default_string(
+			defaults,
+			rendition_key(OBS_SETTING_UI_SENDER_NAME, i).c_str(),
+			"");
+		obs_data_set_default_int(
+			defaults,
+			rendition_key(OBS_SETTING_UI_OUTPUT_SIZE, i).c_str(),
+			NDI_RENDITION_HEIGHTS_DEFAULT[i]);
+	}
+}
+
+namespace Staging {
+
+// Surfaces needed to keep depth frames in flight
+inline static uint32_t ring_size(uint32_t depth)
+{
+	return std::min<uint32_t>(depth + NDI_STAGING_SPARE, NDI_BUFFER_COUNT);
+}
+
+inline static void unmap(void *data, uint32_t slot)
+{
+	auto rendition = (struct rendition *)data;
+
+	gs_stagesurface_unmap(rendition->staging_surface[slot]);
+	rendition->staging_state[slot] = STAGING_FREE;
+}
+
+// Unmaps every surface the worker has finished with
+static void collect(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	uint32_t slot;
+
+	while (rendition->release_queue.pop(slot))
+		Staging::unmap(rendition, slot);
+}
+
+// Unmaps the surface NDI was reading from in zero copy mode -- only safe once
+// NDI has been handed a newer frame (or flushed)
+inline static void release_held(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (rendition->held_slot < 0)
+		return;
+
+	Staging::unmap(rendition, rendition->held_slot);
+	rendition->held_slot = -1;
+}
+
+// Forgets every staged surface without mapping it, they are too old to send
+inline static void discard(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	for (uint32_t i = 0; i < rendition->allocated_staging_count; i++)
+		if (rendition->staging_state[i] == STAGING_PENDING)
+			rendition->staging_state[i] = STAGING_FREE;
+}
+
+// Grows or shrinks the ring to fit the current depth. Only free surfaces at
+// the top of the ring are destroyed, anything busy is retried next frame.
+static void resize(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	const uint32_t target = Staging::ring_size(rendition->staging.depth());
+
+	while (rendition->allocated_staging_count < target) {
+		auto slot = rendition->allocated_staging_count++;
+
+		rendition->staging_surface[slot] = gs_stagesurface_create(
+			rendition->texture_width, rendition->alloc_height,
+			filter->texture_format);
+		rendition->staging_state[slot] = STAGING_FREE;
+	}
+
+	while (rendition->allocated_staging_count > target) {
+		auto slot = rendition->allocated_staging_count - 1;
+
+		if (rendition->staging_state[slot] != STAGING_FREE)
+			break;
+
+		gs_stagesurface_destroy(rendition->staging_surface[slot]);
+		rendition->staging_surface[slot] = nullptr;
+		rendition->allocated_staging_count--;
+	}
+}
+
+// Moves the depth towards whatever keeps maps from stalling, then resizes the
+// ring to match
+static void adapt(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto &staging = rendition->staging;
+
+	const uint32_t maps = staging.maps();
+	const uint32_t stalls = staging.stalls();
+
+	switch (staging.adapt(rendition->filter->config->staging)) {
+	case Depth::GREW:
+		debug("map stalls %u/%u, staging depth up to %u", stalls, maps,
+		      staging.depth());
+		break;
+	case Depth::SHRANK:
+		debug("maps ready, staging depth down to %u", staging.depth());
+		break;
+	case Depth::KEPT:
+		break;
+	}
+
+	Staging::resize(rendition);
+}
+
+// Refines ready_ns. A map that had to wait shows when the copy landed, one
+// that did not only that it had landed by then -- so the guess creeps down
+// until a map waits again.
+static void estimate(void *data, uint64_t age_ns, uint64_t map_ns)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	if (map_ns > filter->config->staging.stall_ns) {
+		rendition->ready_ns =
+			std::max(rendition->ready_ns, age_ns + map_ns);
+	} else {
+		rendition->ready_ns = std::min(rendition->ready_ns, age_ns);
+		rendition->ready_ns -=
+			rendition->ready_ns >> NDI_READY_DECAY_SHIFT;
+	}
+}
+
+// Maps the newest surface that is ready, older ones it overtook are recycled
+// without ever being mapped. Ready means in flight for as many frames as the
+// staging depth, or in low latency mode for as long as copies seem to take.
+// Every map is timed.
+static bool map(void *data, worker_frame *frame)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	const uint64_t now = os_gettime_ns();
+
+	auto is_ready = [rendition, filter, now](uint32_t i) {
+		if (filter->config->low_latency)
+			return now - rendition->staged_ns[i] >=
+			       rendition->ready_ns;
+
+		return filter->frame_count - rendition->staged_frame[i] >=
+		       rendition->staging.depth();
+	};
+
+	int32_t ready = -1;
+	int32_t oldest = -1;
+	bool full = true;
+
+	for (uint32_t i = 0; i < rendition->allocated_staging_count; i++) {
+		if (rendition->staging_state[i] == STAGING_FREE)
+			full = false;
+
+		if (rendition->staging_state[i] != STAGING_PENDING)
+			continue;
+
+		if (oldest < 0 || rendition->staged_frame[i] <
+					  rendition->staged_frame[oldest])
+			oldest = i;
+
+		if (!is_ready(i))
+			continue;
+
+		if (ready < 0 || rendition->staged_frame[i] >
+					 rendition->staged_frame[ready]) {
+			if (ready >= 0)
+				rendition->staging_state[ready] = STAGING_FREE;
+			ready = i;
+		} else {
+			rendition->staging_state[i] = STAGING_FREE;
+		}
+	}
+
+	// Nothing looks ready but there is nowhere left to stage -- waiting on
+	// the oldest beats dropping the frame we are about to capture
+	if (ready < 0 && filter->config->low_latency && full)
+		ready = oldest;
+
+	if (ready < 0)
+		return false;
+
+	frame->slot = ready;
+	frame->staged_frame = rendition->staged_frame[ready];
+	frame->staged_ns = rendition->staged_ns[ready];
+	frame->frame_rate_N = rendition->frame_rate_N;
+	frame->frame_rate_D = rendition->frame_rate_D;
+	frame->timecode = (int64_t)(rendition->staged_video_time[ready] / 100);
+	frame->config = filter->config;
+
+	const uint64_t start = os_gettime_ns();
+
+	const bool mapped =
+		gs_stagesurface_map(rendition->staging_surface[ready],
+				    &frame->data, &frame->linesize);
+
+	const uint64_t map_ns = os_gettime_ns() - start;
+
+	rendition->staging.record(map_ns, filter->config->staging);
+	Staging::estimate(rendition, start - frame->staged_ns, map_ns);
+
+	if (!mapped) {
+		rendition->staging_state[ready] = STAGING_FREE;
+		return false;
+	}
+
+	rendition->staging_state[ready] = STAGING_MAPPED;
+	return true;
+}
+
+// Called by whichever thread sent the frame, there is only ever one
+static void sent(void *data, const worker_frame &frame)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	const uint32_t frames = filter->frame_count - frame.staged_frame;
+
+	rendition->latency_frames += frames;
+	rendition->latency_ns += os_gettime_ns() - frame.staged_ns;
+	rendition->latency_samples++;
+
+	if (frames > rendition->latency_max)
+		rendition->latency_max = frames;
+}
+
+// Logs and clears the latency counters
+static void reset_latency(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (rendition->latency_samples) {
+		double frames, ms;
+		uint32_t max;
+		send_latency(rendition, &frames, &ms, &max);
+
+		debug("latency %.2f frames (%.1f ms) average, %u max over %llu frames",
+		      frames, ms, max,
+		      (unsigned long long)rendition->latency_samples.load());
+	}
+
+	rendition->latency_frames = 0;
+	rendition->latency_ns = 0;
+	rendition->latency_samples = 0;
+	rendition->latency_max = 0;
+}
+
+// A surface we can stage into, applying the back-pressure policy if the
+// worker has all of them. -1 drops the frame.
+static int32_t acquire(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	auto find_free = [rendition]() -> int32_t {
+		for (uint32_t i = 0; i < rendition->allocated_staging_count;
+		     i++)
+			if (rendition->staging_state[i] == STAGING_FREE)
+				return i;
+		return -1;
+	};
+
+	auto slot = find_free();
+
+	if (slot >= 0 || !rendition->worker_active ||
+	    filter->config->backpressure != BACKPRESSURE_BLOCK)
+		return slot;
+
+	const auto deadline = std::chrono::steady_clock::now() +
+			      std::chrono::milliseconds(NDI_BLOCK_TIMEOUT_MS);
+
+	while (slot < 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		Staging::collect(rendition);
+		slot = find_free();
+	}
+
+	return slot;
+}
+
+static void stage(void *data, uint32_t slot, gs_texture_t *texture)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	gs_stage_texture(rendition->staging_surface[slot], texture);
+
+	rendition->staging_state[slot] = STAGING_PENDING;
+	rendition->staged_frame[slot] = filter->frame_count;
+	rendition->staged_ns[slot] = os_gettime_ns();
+	rendition->staged_video_time[slot] = obs_get_video_frame_time();
+}
+
+} // namespace Staging
+
+namespace Textures {
+
+inline static void destroy(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	// Anything NDI or the worker still had is done with by now
+	for (uint32_t i = 0; i < rendition->allocated_staging_count; i++)
+		if (rendition->staging_state[i] == STAGING_MAPPED)
+			Staging::unmap(rendition, i);
+
+	rendition->held_slot = -1;
+
+	std::ranges::for_each(rendition->staging_surface, [](auto &elm) {
+		gs_stagesurface_destroy(elm);
+		elm = nullptr;
+	});
+	rendition->allocated_staging_count = 0;
+
+	gs_texture_destroy(rendition->render_texture);
+	rendition->render_texture = nullptr;
+
+	gs_texture_destroy(rendition->scaled_texture);
+	rendition->scaled_texture = nullptr;
+}
+
+// Packing a scaled output needs a texture at the output size in between
+inline static bool scaled(void *data, uint32_t width, uint32_t height)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	return rendition->allocated_format == OUTPUT_FORMAT_UYVY_GPU &&
+	       (filter->canvas || filter->source_width != width ||
+		filter->source_height != height);
+}
+
+// The render target is at the allocated size, narrower still if the output
+// format is packed on the GPU
+inline static void create(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	Staging::resize(rendition);
+
+	rendition->render_texture = gs_texture_create(
+		rendition->texture_width, rendition->alloc_height,
+		filter->texture_format, 1, NULL, GS_RENDER_TARGET);
+
+	if (Textures::scaled(rendition, rendition->width, rendition->height))
+		rendition->scaled_texture = gs_texture_create(
+			rendition->alloc_width, rendition->alloc_height,
+			filter->texture_format, 1, NULL, GS_RENDER_TARGET);
+}
+
+// The full size capture -- needed unless the primary is sent exactly as
+// captured, in which case it is captured straight into the primary's render
+// target. Proxies are scaled from whichever it is.
+static void capture(void *data)
+{
+	auto filter = (struct filter *)data;
+	auto primary = &filter->renditions[0];
+
+	// A fixed canvas is always letterboxed by a scale pass
+	const bool needed =
+		filter->canvas ||
+		primary->allocated_format == OUTPUT_FORMAT_UYVY_GPU ||
+		primary->width != filter->source_width ||
+		primary->height != filter->source_height;
+
+	const uint32_t width = filter->content_width;
+	const uint32_t height = filter->content_height;
+
+	// It holds the source at the source's own size, top left, and is kept
+	// while the source fits it. On a canvas it only ever grows.
+	if (needed && filter->capture_texture) {
+		const uint32_t cx = gs_texture_get_width(filter->capture_texture);
+		const uint32_t cy =
+			gs_texture_get_height(filter->capture_texture);
+
+		if (filter->canvas ? width <= cx && height <= cy
+				   : Resize::reusable(cx, cy, width, height))
+			return;
+	}
+
+	gs_texture_destroy(filter->capture_texture);
+	filter->capture_texture = nullptr;
+	filter->captured_texture = nullptr;
+
+	if (needed)
+		filter->capture_texture = gs_texture_create(
+			Resize::bucket(width), Resize::bucket(height),
+			filter->texture_format, 1, NULL, GS_RENDER_TARGET);
+}
+
+} // namespace Textures
+
+namespace Tiles {
+
+// Planar formats keep a second plane below the first, a tile can not be cut
+// out of those by pointer and stride alone
+static bool sliceable(uint32_t output_format)
+{
+	return output_format != OUTPUT_FORMAT_UYVA_CPU &&
+	       output_format != OUTPUT_FORMAT_NV12_CPU;
+}
+
+static std::string name(void *data, uint32_t index)
+{
+	auto rendition = (struct rendition *)data;
+
+	char name[256];
+	snprintf(name, sizeof(name),
+		 obs_module_text(OBS_SETTING_DEFAULT_TILE_NAME),
+		 rendition->sender_name.c_str(), index + 1);
+
+	return name;
+}
+
+// Maps every tile onto the frame the rendition sends, clipped to it. Called
+// with the worker stopped, once the rendition's layout is known.
+static void layout(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (!rendition->source_width || !rendition->source_height)
+		return;
+
+	// A 4:2:2 pair can not be split between two tiles
+	const uint64_t align =
+		rendition->allocated_format == OUTPUT_FORMAT_UYVY_GPU ||
+				rendition->allocated_format ==
+					OUTPUT_FORMAT_UYVY_CPU
+			? 2
+			: 1;
+
+	auto scale = [](uint64_t v, uint32_t to, uint32_t from) {
+		return v * to / from;
+	};
+
+	for (uint32_t i = 0; i < rendition->tile_count; i++) {
+		auto &tile = rendition->tiles[i];
+		auto &rect = tile.rect;
+
+		uint64_t x0 = scale(rect.x, rendition->width,
+				    rendition->source_width);
+		uint64_t x1 = scale((uint64_t)rect.x + rect.width,
+				    rendition->width, rendition->source_width);
+		uint64_t y0 = scale(rect.y, rendition->height,
+				    rendition->source_height);
+		uint64_t y1 = scale((uint64_t)rect.y + rect.height,
+				    rendition->height, rendition->source_height);
+
+		x0 = std::min<uint64_t>(x0, rendition->frame_width);
+		x1 = std::min<uint64_t>(x1, rendition->frame_width);
+		y0 = std::min<uint64_t>(y0, rendition->height);
+		y1 = std::min<uint64_t>(y1, rendition->height);
+
+		x0 &= ~(align - 1);
+		x1 &= ~(align - 1);
+
+		tile.x = (uint32_t)x0;
+		tile.y = (uint32_t)y0;
+
+		auto &frame = tile.ndi_video_frame;
+
+		// Left empty, and not sent, if it falls outside the frame
+		frame.xres = x1 > x0 ? (int)(x1 - x0) : 0;
+		frame.yres = y1 > y0 ? (int)(y1 - y0) : 0;
+		frame.FourCC = rendition->ndi_video_frame.FourCC;
+		frame.frame_format_type = NDIlib_frame_format_type_progressive;
+
+		// The shape of the tile on the source, not in the scaled frame
+		if (frame.xres && frame.yres)
+			frame.picture_aspect_ratio =
+				((float)frame.xres * rendition->source_width /
+				 rendition->width) /
+				((float)frame.yres * rendition->source_height /
+				 rendition->height);
+	}
+}
+
+// Sends every tile out of the buffer the rendition has just sent, at its full
+// row pitch -- no copies. NDI holds the buffer for each tile until that tile's
+// next send, and tiles are always sent together with the rendition, so the
+// rendition's pool stays safe to reuse.
+static void send(void *data, uint8_t *buffer, uint32_t stride)
+{
+	auto rendition = (struct rendition *)data;
+	auto &source = rendition->ndi_video_frame;
+
+	for (uint32_t i = 0; i < rendition->tile_count; i++) {
+		auto &tile = rendition->tiles[i];
+		auto &frame = tile.ndi_video_frame;
+
+		if (!tile.ndi_sender || !frame.xres || !frame.yres)
+			continue;
+
+		frame.p_data = buffer + (size_t)tile.y * stride +
+			       (size_t)tile.x * rendition->depth;
+		frame.line_stride_in_bytes = stride;
+		frame.frame_rate_N = source.frame_rate_N;
+		frame.frame_rate_D = source.frame_rate_D;
+		frame.timecode = source.timecode;
+
+		ndi5_lib->send_send_video_async_v2(tile.ndi_sender, &frame);
+	}
+}
+
+// Makes NDI let go of whatever buffer the tiles were last sent from
+static void flush(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	for (uint32_t i = 0; i < rendition->tile_count; i++)
+		if (rendition->tiles[i].ndi_sender)
+			ndi5_lib->send_send_video_async_v2(
+				rendition->tiles[i].ndi_sender, NULL);
+}
+
+// Senders a swap replaced, destroyed by the monitor once it has stopped
+// polling them (or here, with no monitor running)
+static void retire(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	NDIlib_send_instance_t retired[NDI_TILE_COUNT];
+	uint32_t count;
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+
+		count = rendition->tile_retired_count;
+		std::copy_n(rendition->tile_retired, count, retired);
+		rendition->tile_retired_count = 0;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		ndi5_lib->send_destroy(retired[i]);
+}
+
+// A built set never swapped in, its new senders have sent nothing
+static void discard(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (!rendition->tile_ready)
+		return;
+
+	std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+
+	auto &build = rendition->tile_built;
+
+	for (uint32_t i = 0; i < build.count; i++)
+		if (build.senders[i])
+			ndi5_lib->send_destroy(build.senders[i]);
+
+	build = {};
+	rendition->tile_ready = false;
+}
+
+// With the monitor stopped, a set still being built is swapped in later
+static void destroy(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	Tiles::discard(rendition);
+	Tiles::retire(rendition);
+
+	for (auto &tile : rendition->tiles) {
+		if (tile.ndi_sender)
+			ndi5_lib->send_destroy(tile.ndi_sender);
+
+		tile.ndi_sender = nullptr;
+		tile.sender_name.clear();
+	}
+
+	rendition->tile_count = 0;
+	rendition->tile_connections = 0;
+
+	// Asked for again once there is a sender
+	rendition->tile_request_count = 0;
+	rendition->tile_request_name.clear();
+}
+
+// filter_destroy -- a set still being built is waited for and dropped
+static void finish(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (rendition->tile_thread.joinable())
+		rendition->tile_thread.join();
+
+	Tiles::destroy(rendition);
+}
+
+// tile_thread -- NDI announces every new sender before send_create returns,
+// a whole video wall can take a while
+static void create(void *data, tile_build build)
+{
+	auto rendition = (struct rendition *)data;
+
+	for (uint32_t i = 0; i < build.count; i++) {
+		if (build.kept[i])
+			continue;
+
+		build.senders[i] =
+			Sender::create(ndi5_lib, build.names[i].c_str());
+
+		if (!build.senders[i])
+			error("could not create ndi sender '%s'",
+			      build.names[i].c_str());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+		rendition->tile_built = std::move(build);
+		rendition->tile_ready = true;
+	}
+
+	rendition->tile_busy = false;
+}
+
+// filter_video_tick -- asks for the tiles the settings, and the name they
+// derive from, call for. One set in flight at a time, a change in the
+// meantime is picked up on a later frame. Never waits on NDI.
+static void request(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto config = rendition->filter->config.get();
+
+	if (!rendition->sender_created || rendition->tile_busy ||
+	    rendition->tile_ready)
+		return;
+
+	const uint32_t count =
+		config->tiling && sliceable(config->output_format)
+			? config->tile_rect_count
+			: 0;
+
+	bool changed = count != rendition->tile_request_count ||
+		       (count && rendition->tile_request_name !=
+					 rendition->sender_name);
+
+	for (uint32_t i = 0; i < count && !changed; i++) {
+		auto &a = rendition->tile_request_rects[i];
+		auto &b = config->tile_rects[i];
+
+		changed = a.x != b.x || a.y != b.y || a.width != b.width ||
+			  a.height != b.height;
+	}
+
+	if (!changed)
+		return;
+
+	// Already finished, this returns straight away
+	if (rendition->tile_thread.joinable())
+		rendition->tile_thread.join();
+
+	tile_build build = {};
+	build.count = count;
+	build.base_name = rendition->sender_name;
+
+	for (uint32_t i = 0; i < count; i++) {
+		build.rects[i] = config->tile_rects[i];
+		build.names[i] = Tiles::name(rendition, i);
+
+		// Only moved, or renamed back, the sender is kept
+		for (uint32_t j = 0; j < rendition->tile_count; j++)
+			if (rendition->tiles[j].ndi_sender &&
+			    rendition->tiles[j].sender_name == build.names[i])
+				build.kept[i] = true;
+
+		rendition->tile_request_rects[i] = build.rects[i];
+	}
+
+	rendition->tile_request_count = count;
+	rendition->tile_request_name = rendition->sender_name;
+
+	rendition->tile_busy = true;
+	rendition->tile_thread =
+		std::thread(Tiles::create, rendition, std::move(build));
+}
+
+// filter_video_tick -- puts a built set of tiles in place of the current
+// one, senders of the same name are kept. Waits a frame if the monitor has
+// yet to destroy the last ones replaced.
+static void swap(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	if (!rendition->tile_ready || !rendition->sender_created)
+		return;
+
+	tile_build build;
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+
+		if (rendition->tile_retired_count)
+			return;
+
+		build = std::move(rendition->tile_built);
+		rendition->tile_built = {};
+		rendition->tile_ready = false;
+	}
+
+	// Nothing may send on the old tiles past here, the tick is outside
+	// the graphics context
+	obs_enter_graphics();
+	Worker::stop(rendition);
+	obs_leave_graphics();
+
+	// NDI must let go of the last frame they were given
+	Tiles::flush(rendition);
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+
+		for (uint32_t i = 0; i < build.count; i++) {
+			if (!build.kept[i])
+				continue;
+
+			for (uint32_t j = 0; j < rendition->tile_count; j++) {
+				auto &tile = rendition->tiles[j];
+
+				if (tile.ndi_sender &&
+				    tile.sender_name == build.names[i]) {
+					build.senders[i] = tile.ndi_sender;
+					tile.ndi_sender = nullptr;
+					break;
+				}
+			}
+
+			// Gone since it was asked for, asked for again
+			if (!build.senders[i])
+				rendition->tile_request_count = 0;
+		}
+
+		for (auto &tile : rendition->tiles)
+			if (tile.ndi_sender)
+				rendition->tile_retired
+					[rendition->tile_retired_count++] =
+					tile.ndi_sender;
+
+		for (uint32_t i = 0; i < NDI_TILE_COUNT; i++) {
+			auto &tile = rendition->tiles[i];
+
+			tile.rect = build.rects[i];
+			tile.ndi_sender = build.senders[i];
+			tile.sender_name = std::move(build.names[i]);
+		}
+
+		rendition->tile_count = build.count;
+	}
+
+	rendition->tile_base_name = build.base_name;
+	rendition->tile_connections = 0;
+
+	if (!rendition->monitor_active)
+		Tiles::retire(rendition);
+
+	Tiles::layout(rendition);
+
+	info("'%s' video wall -- %u tiles", rendition->sender_name.c_str(),
+	     build.count);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+} // namespace Tiles
+
+namespace Framebuffers {
+
+// Forces NDI to process the previous frame, freeing the use of any memory we gave it
+inline static void flush(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	ndi5_lib->send_send_video_async_v2(rendition->ndi_sender, NULL);
+
+	Tiles::flush(rendition);
+}
+
+inline static void update_ndi_video_frame_desc(void *data, uint32_t width,
+					       uint32_t height, uint32_t stride)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (!rendition->first_run_update) {
+		rendition->first_run_update = true;
+		rendition->ndi_video_frame.frame_format_type =
+			NDIlib_frame_format_type_e::
+				NDIlib_frame_format_type_progressive;
+	}
+
+	switch (rendition->allocated_format) {
+	case OUTPUT_FORMAT_UYVY_GPU:
+	case OUTPUT_FORMAT_UYVY_CPU:
+		rendition->ndi_video_frame.FourCC = NDIlib_FourCC_type_UYVY;
+		break;
+	case OUTPUT_FORMAT_UYVA_CPU:
+		rendition->ndi_video_frame.FourCC = NDIlib_FourCC_type_UYVA;
+		break;
+	case OUTPUT_FORMAT_BGRX_CPU:
+		rendition->ndi_video_frame.FourCC = NDIlib_FourCC_type_BGRX;
+		break;
+	case OUTPUT_FORMAT_NV12_CPU:
+		rendition->ndi_video_frame.FourCC = NDIlib_FourCC_type_NV12;
+		break;
+	default:
+		rendition->ndi_video_frame.FourCC = NDIlib_FourCC_type_RGBA;
+		break;
+	}
+
+	// Update dimensions
+	rendition->ndi_video_frame.xres = width;
+	rendition->ndi_video_frame.yres = height;
+
+	// The source's shape, not the frame's -- rounding a packed width up to
+	// even or scaling it down must not stretch the picture
+	rendition->ndi_video_frame.picture_aspect_ratio =
+		(float)rendition->source_width /
+		(float)rendition->source_height;
+
+	rendition->ndi_video_frame.line_stride_in_bytes = stride;
+}
+
+// Back to the shared pool, the next create at a size they hold (this
+// filter's or another's) takes them again
+inline static void destroy(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	rendition->frame_buffers.destroy(*ndi5_frame_pool);
+}
+
+inline static void create(void *data, uint32_t width, uint32_t height,
+			  uint32_t stride, size_t size)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (rendition->frame_buffers.allocated()) {
+		warn("NDI5 frame buffers destroyed unexpectedly");
+		Framebuffers::destroy(rendition);
+	}
+
+	// Update NDI5 ndi_video_frame desc
+	update_ndi_video_frame_desc(rendition, width, height, stride);
+
+	// Create the frame buffers -- not cleared, every byte sent is copied in
+	// first. The shared pool may be at its cap, frames are dropped until a
+	// later try fits.
+	if (!rendition->frame_buffers.create(
+		    *ndi5_frame_pool, rendition->allocated_frame_buffer_count,
+		    size)) {
+		if (!rendition->frame_refused)
+			warn("'%s' frame buffers refused, %.1f MB held by all filters -- dropping frames until they fit",
+			     rendition->sender_name.c_str(),
+			     ndi5_frame_pool->get_stats().bytes / 1048576.0);
+
+		rendition->frame_refused = true;
+		return;
+	}
+
+	if (rendition->frame_refused)
+		info("'%s' frame buffers fit again",
+		     rendition->sender_name.c_str());
+
+	rendition->frame_refused = false;
+}
+
+// Given back while idle or refused at the cap -- tried again for every frame
+// that needs them, on whichever thread sends
+inline static bool refill(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	if (!rendition->frame_buffers.allocated())
+		Framebuffers::create(rendition, rendition->frame_width,
+				     rendition->height, rendition->stride,
+				     rendition->alloc_size);
+
+	return rendition->frame_buffers.allocated();
+}
+
+// filter_video_tick -- another rendition was refused at the cap, an
+// unwatched one gives its frame buffers back (shown or not) and takes them
+// again when a receiver turns up
+inline static void evict(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	if (!rendition->frame_buffers.allocated() ||
+	    !ndi5_frame_pool->pressure())
+		return;
+
+	// The worker may still be copying into them, NDI reading one
+	obs_enter_graphics();
+	Worker::stop(rendition);
+	obs_leave_graphics();
+
+	Framebuffers::flush(rendition);
+
+	uint64_t textures, staging, buffers;
+	pool_memory(rendition, &textures, &staging, &buffers);
+
+	Framebuffers::destroy(rendition);
+
+	info("'%s' idle, %.1f MB of frame buffers back to the shared pool",
+	     rendition->sender_name.c_str(), buffers / 1048576.0);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+// Hands one frame to NDI, buffer is one of ours or mapped staging memory. The
+// async send holds on to it until the next send (or flush).
+static void send(void *data, const worker_frame &frame, uint8_t *buffer,
+		 uint32_t stride)
+{
+	auto rendition = (struct rendition *)data;
+
+	rendition->ndi_video_frame.p_data = buffer;
+	rendition->ndi_video_frame.line_stride_in_bytes = stride;
+	rendition->ndi_video_frame.frame_rate_N = frame.frame_rate_N;
+	rendition->ndi_video_frame.frame_rate_D = frame.frame_rate_D;
+	rendition->ndi_video_frame.timecode = frame.timecode;
+
+	ndi5_lib->send_send_video_async_v2(rendition->ndi_sender,
+					   &rendition->ndi_video_frame);
+
+	Tiles::send(rendition, buffer, stride);
+
+	Staging::sent(rendition, frame);
+}
+
+// The staging surface came back with a different pitch than we guessed --
+// rebuild the frame buffers with that pitch so rows never need repacking
+inline static void match_linesize(void *data, uint32_t linesize)
+{
+	auto rendition = (struct rendition *)data;
+
+	debug("adopting staging linesize %u (was %u)", linesize,
+	      rendition->stride.load());
+
+	rendition->stride = linesize;
+	rendition->size = linesize * rendition->height;
+	rendition->alloc_size = linesize * rendition->alloc_height;
+
+	Framebuffers::flush(rendition);
+	Framebuffers::destroy(rendition);
+	Framebuffers::create(rendition, rendition->frame_width,
+			     rendition->height, rendition->stride,
+			     rendition->alloc_size);
+}
+
+} // namespace Framebuffers
+
+namespace Texture {
+
+// Which CPU kernel an output format needs, false if it is a straight copy
+static bool kernel_format(uint32_t output_format, Kernels::format *fmt)
+{
+	switch (output_format) {
+	case OUTPUT_FORMAT_UYVY_CPU:
+		*fmt = Kernels::FORMAT_UYVY;
+		return true;
+	case OUTPUT_FORMAT_UYVA_CPU:
+		*fmt = Kernels::FORMAT_UYVA;
+		return true;
+	case OUTPUT_FORMAT_BGRX_CPU:
+		*fmt = Kernels::FORMAT_BGRX;
+		return true;
+	case OUTPUT_FORMAT_NV12_CPU:
+		*fmt = Kernels::FORMAT_NV12;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Rounds a row pitch up to NDI_BUFFER_ALIGNMENT
+static uint32_t align_stride(uint32_t stride)
+{
+	return (stride + NDI_BUFFER_ALIGNMENT - 1) & ~(NDI_BUFFER_ALIGNMENT - 1);
+}
+
+// Works out the NDI frame for width x height inside the buffers we have --
+// the row pitch belongs to the buffers and is left alone
+static void frame_layout(void *data, uint32_t width, uint32_t height)
+{
+	auto rendition = (struct rendition *)data;
+
+	Kernels::format fmt;
+	uint32_t texels;
+
+	if (rendition->allocated_format == OUTPUT_FORMAT_UYVY_GPU) {
+		// Two pixels per RGBA texel -- U Y0 V Y1
+		texels = (width + 1) / 2;
+		rendition->frame_width = texels * 2;
+		rendition->depth = 2;
+	} else if (Texture::kernel_format(rendition->allocated_format, &fmt)) {
+		texels = width;
+		rendition->frame_width = fmt == Kernels::FORMAT_BGRX
+						 ? width
+						 : (width + 1) & ~1u;
+		rendition->depth = Kernels::frame_stride(fmt, width) /
+				   rendition->frame_width;
+	} else {
+		texels = width;
+		rendition->frame_width = width;
+		rendition->depth = 4;
+	}
+
+	rendition->row_bytes = texels * 4;
+
+	if (Texture::kernel_format(rendition->allocated_format, &fmt))
+		rendition->size = (uint32_t)Kernels::frame_size(
+			fmt, rendition->stride, height);
+	else
+		rendition->size = rendition->stride * height;
+}
+
+// Works out the ring texture and NDI frame layout for the current format. The
+// textures and buffers are sized up to the next bucket, so later sizes that
+// fit them need no reallocation.
+static void layout(void *data, uint32_t width, uint32_t height)
+{
+	auto rendition = (struct rendition *)data;
+
+	rendition->alloc_width = Resize::bucket(width);
+	rendition->alloc_height = Resize::bucket(height);
+
+	rendition->texture_width =
+		rendition->allocated_format == OUTPUT_FORMAT_UYVY_GPU
+			? rendition->alloc_width / 2
+			: rendition->alloc_width;
+
+	Kernels::format fmt;
+
+	if (Texture::kernel_format(rendition->allocated_format, &fmt)) {
+		// We write every row ourselves, any aligned pitch will do
+		rendition->stride = align_stride(
+			Kernels::frame_stride(fmt, rendition->alloc_width));
+		rendition->alloc_size = (uint32_t)Kernels::frame_size(
+			fmt, rendition->stride, rendition->alloc_height);
+	} else {
+		// Best guess at the staging pitch, corrected on the first map
+		rendition->stride = align_stride(rendition->texture_width * 4);
+		rendition->alloc_size =
+			rendition->stride * rendition->alloc_height;
+	}
+
+	Texture::frame_layout(rendition, width, height);
+}
+
+// Rebuilds the texture ring, staging ring and frame buffer pool at their
+// current sizes -- the NDI sender is left alone
+static void rebuild_pools(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	rendition->allocated_frame_buffer_count =
+		filter->config->frame_buffer_count;
+	rendition->frame_buffer_index = 0;
+
+	Staging::reset_latency(rendition);
+
+	// NDI must let go of any frame before its memory goes away
+	Framebuffers::flush(rendition);
+
+	// Texture buffers
+	Textures::destroy(rendition);
+	Textures::create(rendition);
+	filter->captured_texture = nullptr;
+
+	// NDI frame buffers
+	Framebuffers::destroy(rendition);
+	Framebuffers::create(rendition, rendition->frame_width,
+			     rendition->height, rendition->stride,
+			     rendition->alloc_size);
+
+	uint64_t textures, staging, buffers;
+	pool_memory(rendition, &textures, &staging, &buffers);
+
+	info("'%s' %ux%u pools -- render targets %.1f MB, staging %.1f MB, frame buffers %.1f MB (%.1f MB across all filters)",
+	     rendition->sender_name.c_str(), rendition->width,
+	     rendition->height, textures / 1048576.0, staging / 1048576.0,
+	     buffers / 1048576.0,
+	     ndi5_frame_pool->get_stats().bytes / 1048576.0);
+}
+
+// Frame buffer pool or the send mode changed -- same frame, same sender
+static void resize_pools(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	Worker::stop(rendition);
+
+	Texture::rebuild_pools(rendition);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+// What we send for a cx x cy capture -- the output size setting, then scaled
+// down further once off air has held (Tally::state)
+static void output_size(void *data, uint32_t cx, uint32_t cy, uint32_t *width,
+			uint32_t *height)
+{
+	auto rendition = (struct rendition *)data;
+	auto config = rendition->filter->config.get();
+
+	*width = cx;
+	*height = cy;
+
+	const uint32_t output_size = config->output_size[rendition->index];
+
+	if (output_size != NDI_OUTPUT_SIZE_SOURCE && output_size < cy) {
+		*height = output_size;
+		*width = (uint32_t)(((uint64_t)cx * *height + cy / 2) / cy) &
+			 ~1u;
+	}
+
+	const uint32_t scale = rendition->tally.scale();
+
+	*width = std::max<uint32_t>(*width / scale, 1);
+	*height = std::max<uint32_t>(*height / scale, 1);
+}
+
+// Rebuilds everything for the current capture and output size -- the caller
+// stops and restarts the worker
+static void apply_size(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	rendition->source_width = filter->source_width;
+	rendition->source_height = filter->source_height;
+	rendition->allocated_format = filter->config->output_format;
+
+	Texture::output_size(rendition, rendition->source_width,
+			     rendition->source_height, &rendition->width,
+			     &rendition->height);
+
+	Texture::layout(rendition, rendition->width, rendition->height);
+
+	Texture::rebuild_pools(rendition);
+
+	Tiles::layout(rendition);
+
+	// Whether the primary still captures straight into its render target
+	Textures::capture(filter);
+}
+
+// The new size fits the buffers we have -- only the frame described to NDI
+// changes, nothing is reallocated and the sender is kept
+static void relayout(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	Worker::stop(rendition);
+
+	// Staged at the old size
+	Staging::discard(rendition);
+
+	rendition->source_width = filter->source_width;
+	rendition->source_height = filter->source_height;
+
+	Texture::output_size(rendition, rendition->source_width,
+			     rendition->source_height, &rendition->width,
+			     &rendition->height);
+
+	Texture::frame_layout(rendition, rendition->width, rendition->height);
+
+	Framebuffers::update_ndi_video_frame_desc(rendition,
+						  rendition->frame_width,
+						  rendition->height,
+						  rendition->stride);
+
+	Tiles::layout(rendition);
+
+	Textures::capture(filter);
+
+	filter->resizes_reused++;
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+// New size, scale or format -- every buffer is rebuilt, same sender
+static void rescale(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	Worker::stop(rendition);
+
+	Texture::apply_size(rendition);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+// First capture -- everything is built and the sender created, renames go
+// through Rename instead
+static void reset(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	// The worker reads everything we are about to rebuild, the monitor
+	// polls the sender
+	Worker::stop(rendition);
+	Monitor::stop(rendition);
+
+	Texture::apply_size(rendition);
+
+	// Destroy the NDI5 sender
+	if (rendition->sender_created)
+		ndi5_lib->send_destroy(rendition->ndi_sender);
+
+	// Setup the new NDI5 stream
+	rendition->ndi_sender =
+		Sender::create(ndi5_lib, rendition->sender_name.c_str());
+
+	if (!rendition->ndi_sender) {
+		error("could not create ndi sender");
+	}
+
+	rendition->sender_created = true;
+	rendition->rename_name = rendition->sender_name;
+
+	Monitor::start(rendition);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+}
+
+// Proxy switched off -- it gives back everything, sender included
+static void shutdown(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	// Nothing else may send on this sender once the worker is gone
+	Worker::stop(rendition);
+	Monitor::stop(rendition);
+
+	// Flush NDI -- it may still be reading a mapped staging surface
+	Framebuffers::flush(rendition);
+
+	Textures::destroy(rendition);
+	Framebuffers::destroy(rendition);
+
+	Staging::reset_latency(rendition);
+
+	rendition->frames_idle = 0;
+	rendition->frames_decimated = 0;
+
+	Tiles::destroy(rendition);
+
+	if (rendition->sender_created)
+		ndi5_lib->send_destroy(rendition->ndi_sender);
+
+	rendition->ndi_sender = nullptr;
+	rendition->sender_created = false;
+	rendition->width = 0;
+	rendition->height = 0;
+	rendition->connections = 1; // watched until a new monitor says not
+}
+
+// Resize hysteresis -- a new source size has to hold for resize_hold frames
+// before anything is rebuilt for it, frames in between are not captured. A
+// bounce back to the current size costs nothing. True once cx x cy can be
+// captured. Called once per draw, a source in several views only advances
+// the hold once a frame.
+static bool settle(void *data, uint32_t cx, uint32_t cy)
+{
+	auto filter = (struct filter *)data;
+
+	const bool pending = filter->pending_frames > 0;
+
+	// A canvas only moves the letterbox, there is nothing to hold off
+	if (filter->config->canvas_width || !filter->content_width ||
+	    (cx == filter->content_width && cy == filter->content_height)) {
+		if (pending)
+			filter->resizes_ignored++;
+
+		filter->pending_frames = 0;
+		return true;
+	}
+
+	// Bounced to yet another size
+	if (cx != filter->pending_width || cy != filter->pending_height) {
+		if (pending)
+			filter->resizes_ignored++;
+
+		filter->pending_width = cx;
+		filter->pending_height = cy;
+		filter->pending_frames = 0;
+	} else if (filter->pending_frame == filter->frame_count) {
+		// Drawn again in another view, the hold counts frames
+		return false;
+	}
+
+	filter->pending_frame = filter->frame_count;
+
+	if (filter->pending_frames++ < filter->config->resize_hold) {
+		filter->resize_frames_held++;
+		return false;
+	}
+
+	filter->pending_frames = 0;
+	return true;
+}
+
+// Makes sure every rendition's buffers match the size of the texture we are
+// about to capture. False while a new size is still settling.
+static bool prepare(void *data, uint32_t cx, uint32_t cy)
+{
+	auto filter = (struct filter *)data;
+	auto config = filter->config.get();
+
+	if (!Texture::settle(filter, cx, cy))
+		return false;
+
+	// On a fixed canvas the source's size only moves the letterbox
+	const bool canvas = config->canvas_width && config->canvas_height;
+
+	const uint32_t source_width = canvas ? config->canvas_width : cx;
+	const uint32_t source_height = canvas ? config->canvas_height : cy;
+
+	const bool resized = filter->source_width != source_width ||
+			     filter->source_height != source_height ||
+			     filter->canvas != canvas;
+
+	filter->canvas = canvas;
+	filter->source_width = source_width;
+	filter->source_height = source_height;
+	filter->content_width = cx;
+	filter->content_height = cy;
+
+	for (auto &rendition : filter->renditions) {
+		if (!config->enabled[rendition.index]) {
+			if (rendition.sender_created)
+				Texture::shutdown(&rendition);
+			continue;
+		}
+
+		uint32_t width, height;
+		Texture::output_size(&rendition, source_width, source_height,
+				     &width, &height);
+
+		// Created under the current name, a rename only ever swaps the
+		// sender (filter_video_tick)
+		if (!rendition.sender_created)
+			rendition.sender_name =
+				config->sender_name[rendition.index];
+
+		const Resize::built built = {
+			rendition.sender_created,
+			rendition.frame_buffers.allocated(),
+			rendition.allocated_format,
+			rendition.width,
+			rendition.height,
+			rendition.alloc_width,
+			rendition.alloc_height,
+			rendition.scaled_texture != nullptr,
+			rendition.allocated_frame_buffer_count,
+			rendition.worker_active,
+		};
+
+		const Resize::wanted wanted = {
+			resized,
+			config->output_format,
+			width,
+			height,
+			Textures::scaled(&rendition, width, height),
+			config->frame_buffer_count,
+			config->threaded,
+		};
+
+		switch (Resize::plan(built, wanted)) {
+		case Resize::CREATE:
+			Texture::reset(&rendition);
+			break;
+		case Resize::REBUILD:
+			filter->resizes_rebuilt++;
+			[[fallthrough]];
+		case Resize::REFORMAT:
+			Texture::rescale(&rendition);
+			break;
+		case Resize::RELAYOUT:
+			Texture::relayout(&rendition);
+			break;
+		case Resize::POOLS:
+			Texture::resize_pools(&rendition);
+			break;
+		case Resize::KEEP:
+			break;
+		}
+	}
+
+	// Grows the canvas capture if the source outgrew it
+	if (filter->canvas)
+		Textures::capture(filter);
+
+	return true;
+}
+
+// Where the source gets drawn -- straight into the primary's render target,
+// or into a full size texture first if a scale or conversion pass follows
+static gs_texture_t *capture_target(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	if (filter->capture_texture)
+		return filter->capture_texture;
+
+	return filter->renditions[0].render_texture;
+}
+
+// Redirects rendering into the capture target
+static void begin_capture(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	gs_viewport_push();
+	gs_projection_push();
+	gs_matrix_push();
+	gs_matrix_identity();
+
+	filter->prev_target = gs_get_render_target();
+	filter->prev_space = gs_get_color_space();
+
+	gs_set_render_target_with_color_space(Texture::capture_target(filter),
+					      NULL, GS_CS_SRGB);
+
+	// The source's own size, the top left of a canvas capture
+	gs_set_viewport(0, 0, filter->content_width, filter->content_height);
+
+	struct vec4 background;
+
+	vec4_zero(&background);
+
+	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+	gs_ortho(0.0f, (float)filter->content_width, 0.0f,
+		 (float)filter->content_height, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+}
+
+// Restores whatever render target was active before begin_capture
+static void end_capture(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	gs_blend_state_pop();
+
+	gs_set_render_target_with_color_space(filter->prev_target, NULL,
+					      filter->prev_space);
+
+	gs_matrix_pop();
+	gs_projection_pop();
+	gs_viewport_pop();
+}
+
+// Fills the Y'CbCr rows of the colour matrix used by the conversion effect
+static void color_vectors(uint32_t matrix, uint32_t range, struct vec4 *y,
+			  struct vec4 *u, struct vec4 *v)
+{
+	float m[3][4];
+
+	Kernels::color_matrix(matrix == COLOR_MATRIX_601,
+			      range == COLOR_RANGE_FULL, m);
+
+	vec4_set(y, m[0][0], m[0][1], m[0][2], m[0][3]);
+	vec4_set(u, m[1][0], m[1][1], m[1][2], m[1][3]);
+	vec4_set(v, m[2][0], m[2][1], m[2][2], m[2][3]);
+}
+
+// Points rendering at target for a full screen pass of width x height
+static void begin_pass(void *data, gs_texture_t *target, uint32_t width,
+		       uint32_t height)
+{
+	auto filter = (struct filter *)data;
+
+	gs_viewport_push();
+	gs_projection_push();
+	gs_matrix_push();
+	gs_matrix_identity();
+
+	filter->prev_target = gs_get_render_target();
+	filter->prev_space = gs_get_color_space();
+
+	gs_set_render_target(target, NULL);
+
+	gs_set_viewport(0, 0, width, height);
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+}
+
+static void end_pass(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	gs_blend_state_pop();
+
+	gs_set_render_target_with_color_space(filter->prev_target, NULL,
+					      filter->prev_space);
+
+	gs_matrix_pop();
+	gs_projection_pop();
+	gs_viewport_pop();
+}
+
+static gs_effect_t *scale_effect(uint32_t scaler)
+{
+	switch (scaler) {
+	case SCALER_BICUBIC:
+		return obs_get_base_effect(OBS_EFFECT_BICUBIC);
+	case SCALER_LANCZOS:
+		return obs_get_base_effect(OBS_EFFECT_LANCZOS);
+	case SCALER_AREA:
+		return obs_get_base_effect(OBS_EFFECT_AREA);
+	default:
+		return obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	}
+}
+
+// Draws the capture into target at the rendition's output size. On a fixed
+// canvas the source is fitted in the middle, the bars are cleared.
+static void scale(void *data, gs_texture_t *target)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	auto effect = Texture::scale_effect(filter->config->scaler);
+	auto source = Texture::capture_target(filter);
+
+	const bool previous = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+
+	Texture::begin_pass(filter, target, rendition->width,
+			    rendition->height);
+
+	uint32_t width = rendition->width;
+	uint32_t height = rendition->height;
+
+	if (filter->canvas) {
+		const uint64_t cx = filter->content_width;
+		const uint64_t cy = filter->content_height;
+
+		// Widest fit first, then tallest if that overflows
+		height = (uint32_t)((cy * width + cx / 2) / cx);
+
+		if (height > rendition->height) {
+			height = rendition->height;
+			width = (uint32_t)((cx * height + cy / 2) / cy);
+		}
+
+		struct vec4 background;
+
+		vec4_zero(&background);
+
+		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+		gs_matrix_translate3f((float)((rendition->width - width) / 2),
+				      (float)((rendition->height - height) / 2),
+				      0.0f);
+	}
+
+	gs_matrix_scale3f((float)width / filter->content_width,
+			  (float)height / filter->content_height, 1.0f);
+
+	// Same parameters OBS gives these effects when it scales a scene item,
+	// any the effect does not have are simply not found. They describe
+	// the whole texture, a canvas capture can be larger than the source.
+	struct vec2 base_dimension;
+	struct vec2 base_dimension_i;
+
+	vec2_set(&base_dimension, (float)gs_texture_get_width(source),
+		 (float)gs_texture_get_height(source));
+	vec2_set(&base_dimension_i, 1.0f / base_dimension.x,
+		 1.0f / base_dimension.y);
+
+	auto param = gs_effect_get_param_by_name(effect, "base_dimension");
+	if (param)
+		gs_effect_set_vec2(param, &base_dimension);
+
+	param = gs_effect_get_param_by_name(effect, "base_dimension_i");
+	if (param)
+		gs_effect_set_vec2(param, &base_dimension_i);
+
+	param = gs_effect_get_param_by_name(effect, "undistort_factor");
+	if (param)
+		gs_effect_set_float(param, 1.0f);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			      source);
+
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite_subregion(source, 0, 0, 0,
+					 filter->content_width,
+					 filter->content_height);
+
+	Texture::end_pass(filter);
+
+	gs_enable_framebuffer_srgb(previous);
+}
+
+// Packs an output sized texture into the render target as UYVY
+static void pack(void *data, gs_texture_t *source)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	auto effect = filter->uyvy_effect;
+
+	const bool previous = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+
+	// Texels of the frame, the render target can be larger
+	const uint32_t texels = rendition->frame_width / 2;
+
+	Texture::begin_pass(filter, rendition->render_texture, texels,
+			    rendition->height);
+
+	struct vec2 base_dimension;
+	struct vec2 output_dimension;
+	struct vec4 color_vec_y, color_vec_u, color_vec_v;
+
+	vec2_set(&base_dimension, (float)rendition->width,
+		 (float)rendition->height);
+	vec2_set(&output_dimension, (float)texels, (float)rendition->height);
+	color_vectors(filter->config->color_matrix, filter->config->color_range,
+		      &color_vec_y, &color_vec_u, &color_vec_v);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			      source);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect,
+						       "base_dimension"),
+			   &base_dimension);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect,
+						       "output_dimension"),
+			   &output_dimension);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_y"),
+			   &color_vec_y);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_u"),
+			   &color_vec_u);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec_v"),
+			   &color_vec_v);
+
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(nullptr, 0, texels, rendition->height);
+
+	Texture::end_pass(filter);
+
+	gs_enable_framebuffer_srgb(previous);
+}
+
+// Gets the capture into the render target, scaled to the output size and/or
+// packed as UYVY. Not called for the rendition the source is captured into.
+static void convert(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	const bool pack = rendition->allocated_format == OUTPUT_FORMAT_UYVY_GPU;
+
+	auto source = Texture::capture_target(filter);
+
+	// Unpacked, the scale pass is also what copies a full size proxy
+	if (!pack || filter->canvas ||
+	    rendition->width != filter->source_width ||
+	    rendition->height != filter->source_height) {
+		source = pack ? rendition->scaled_texture
+			      : rendition->render_texture;
+		Texture::scale(rendition, source);
+	}
+
+	if (pack)
+		Texture::pack(rendition, source);
+}
+
+// Moves a mapped staging surface into an NDI frame buffer, converting it on
+// the way if the output format needs it
+static void copy(void *data, const worker_frame &frame, uint8_t *dst)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+	auto config = frame.config.get();
+
+	const uint8_t *src = frame.data;
+	const uint32_t linesize = frame.linesize;
+
+	Kernels::format fmt;
+
+	if (Texture::kernel_format(rendition->allocated_format, &fmt)) {
+		if (config->streaming_readback)
+			Kernels::convert_frame_streaming(
+				filter->kernels, fmt, src, linesize, dst,
+				rendition->stride, rendition->width,
+				rendition->height, &config->coefficients);
+		else
+			Kernels::convert_frame(filter->kernels, fmt, src,
+					       linesize, dst, rendition->stride,
+					       rendition->width,
+					       rendition->height,
+					       &config->coefficients);
+		return;
+	}
+
+	// Frame buffers share the staging pitch, so the whole surface is one
+	// contiguous block -- no per row repacking
+	if (linesize == rendition->stride) {
+		if (config->streaming_readback)
+			Kernels::copy_frame_streaming(filter->kernels, src, 0,
+						      dst, 0, rendition->size,
+						      1);
+		else
+			memcpy(dst, src, rendition->size);
+		return;
+	}
+
+	// Pitch mismatch (padded surface), copy only the pixels of each row
+	if (config->streaming_readback) {
+		Kernels::copy_frame_streaming(filter->kernels, src, linesize,
+					      dst, rendition->stride,
+					      rendition->row_bytes,
+					      rendition->height);
+		return;
+	}
+
+	for (uint32_t y = 0; y < rendition->height; y++)
+		memcpy(dst + (size_t)y * rendition->stride,
+		       src + (size_t)y * linesize, rendition->row_bytes);
+}
+
+// Copies a mapped staging surface into our own frame buffers and sends it
+static void send_copy(void *data, const worker_frame &frame)
+{
+	auto rendition = (struct rendition *)data;
+
+	Kernels::format fmt;
+
+	if (frame.linesize != rendition->stride &&
+	    frame.linesize >= rendition->row_bytes &&
+	    !Texture::kernel_format(rendition->allocated_format, &fmt))
+		Framebuffers::match_linesize(rendition, frame.linesize);
+
+	if (!Framebuffers::refill(rendition)) {
+		Staging::unmap(rendition, frame.slot);
+		rendition->frames_unbuffered++;
+		return;
+	}
+
+	const uint32_t index = rendition->frame_buffer_index;
+	auto buffer = rendition->frame_buffers.data(index);
+
+	Texture::copy(rendition, frame, buffer);
+
+	Staging::unmap(rendition, frame.slot);
+
+	// Send the buffer we just filled -- the async send holds it until the
+	// next send, so the pool only has to be two deep
+	Framebuffers::send(rendition, frame, buffer, rendition->stride);
+
+	rendition->frame_buffer_index = (rendition->frame_buffer_index + 1) %
+				     rendition->allocated_frame_buffer_count;
+
+	// Just left zero copy mode, NDI has moved on from the mapped surface
+	Staging::release_held(rendition);
+}
+
+// Zero copy -- NDI reads the mapped staging surface directly. The surface
+// stays mapped until the next async send returns, which is the point NDI
+// guarantees it is done with the previous frame.
+static void send_mapped(void *data, const worker_frame &frame)
+{
+	auto rendition = (struct rendition *)data;
+
+	Framebuffers::send(rendition, frame, frame.data, frame.linesize);
+
+	Staging::release_held(rendition);
+	rendition->held_slot = frame.slot;
+}
+
+// Reads back the newest ready staging surface and sends it, then stages the
+// texture we just captured
+static void readback(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	const uint64_t start = os_gettime_ns();
+
+	if (Texture::capture_target(filter) != rendition->render_texture)
+		Texture::convert(rendition);
+
+	if (rendition->worker_active)
+		Staging::collect(rendition);
+
+	worker_frame frame;
+
+	if (Staging::map(rendition, &frame)) {
+		Kernels::format fmt;
+
+		const bool passthrough = !Texture::kernel_format(
+			rendition->allocated_format, &fmt);
+
+		if (rendition->worker_active)
+			// Copy, convert and send all happen on the worker
+			Worker::submit(rendition, frame);
+		else if (filter->config->zero_copy && passthrough)
+			Texture::send_mapped(rendition, frame);
+		else
+			Texture::send_copy(rendition, frame);
+	}
+
+	// STAGE THE NEXT FRAME
+	// Straight from the texture we just drew, the GPU keeps the copy ordered
+	// before next frame's draw into it
+	auto slot = Staging::acquire(rendition);
+
+	if (slot >= 0)
+		Staging::stage(rendition, slot, rendition->render_texture);
+	else
+		rendition->frames_dropped++;
+
+	Staging::adapt(rendition);
+
+	rendition->readback_ns += os_gettime_ns() - start;
+	rendition->readbacks++;
+}
+
+// Decides which renditions take this frame, true if none of them do. Idle and
+// decimated frames are counted here, once per frame each.
+static bool skip(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	bool skip = true;
+
+	for (auto &rendition : filter->renditions) {
+		rendition.capturing =
+			filter->config->enabled[rendition.index] &&
+			!Monitor::idle(&rendition) && !Pacing::skip(&rendition);
+
+		if (rendition.capturing)
+			skip = false;
+	}
+
+	return skip;
+}
+
+// Every rendition taking this frame reads back its own copy of the capture
+static void distribute(void *data)
+{
+	auto filter = (struct filter *)data;
+
+	for (auto &rendition : filter->renditions)
+		if (rendition.capturing && rendition.sender_created)
+			Texture::readback(&rendition);
+
+	filter->captured_frame = filter->frame_count;
+}
+
+// Fallback path -- renders the parent source a second time into our ring
+static void render(void *data, obs_source_t *target, uint32_t cx, uint32_t cy)
+{
+	auto filter = (struct filter *)data;
+
+	if (!Texture::prepare(filter, cx, cy))
+		return;
+
+	Texture::begin_capture(filter);
+
+	obs_source_video_render(target);
+
+	Texture::end_capture(filter);
+
+	Texture::distribute(filter);
+}
+
+// Draws a captured texture into whatever render target is currently active.
+// Only its top left cx x cy, a canvas capture can be larger than the source.
+static void draw(gs_texture_t *texture, uint32_t cx, uint32_t cy)
+{
+	const bool previous = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(true);
+
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture_srgb(image, texture);
+
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite_subregion(texture, 0, 0, 0, cx, cy);
+
+	gs_enable_framebuffer_srgb(previous);
+}
+
+// Filter chain path -- the texture the chain already produced goes straight
+// into our ring, and is then drawn back out so the chain continues as normal.
+// Returns false if the filter chain could not be processed this frame.
+static bool capture(void *data, uint32_t cx, uint32_t cy)
+{
+	auto filter = (struct filter *)data;
+
+	if (!Texture::prepare(filter, cx, cy))
+		return false;
+
+	if (!obs_source_process_filter_begin(filter->context,
+					     filter->texture_format,
+					     OBS_ALLOW_DIRECT_RENDERING))
+		return false;
+
+	auto texture = Texture::capture_target(filter);
+
+	Texture::begin_capture(filter);
+
+	obs_source_process_filter_end(filter->context,
+				      obs_get_base_effect(OBS_EFFECT_DEFAULT),
+				      cx, cy);
+
+	Texture::end_capture(filter);
+
+	Texture::draw(texture, cx, cy);
+
+	Texture::distribute(filter);
+
+	filter->captured_texture = texture;
+	filter->filter_captured_frame = filter->frame_count;
+
+	return true;
+}
+
+} // namespace Texture
+
+namespace Worker {
+
+// Wakes the worker -- the lock only orders us against its wait, the queues
+// themselves never take it
+inline static void wake(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->worker_mutex);
+	}
+
+	rendition->worker_wake.notify_one();
+}
+
+// Worker side -- gives a staging surface back to the graphics thread. Can not
+// fail, there are never more than NDI_BUFFER_COUNT surfaces in flight.
+inline static void release(void *data, uint32_t slot)
+{
+	auto rendition = (struct rendition *)data;
+	rendition->release_queue.push(slot);
+}
+
+// Graphics side -- hands a mapped surface to the worker. Can not fail either.
+static void submit(void *data, const worker_frame &frame)
+{
+	auto rendition = (struct rendition *)data;
+
+	rendition->work_queue.push(frame);
+	Worker::wake(rendition);
+}
+
+// Worker side -- copies or converts one mapped frame and sends it. held_slot is
+// the surface NDI is reading from in zero copy mode, -1 if none.
+static void send(void *data, const worker_frame &frame, int32_t &held_slot,
+		 uint32_t &buffer_index)
+{
+	auto rendition = (struct rendition *)data;
+
+	Kernels::format fmt;
+
+	const bool passthrough =
+		!Texture::kernel_format(rendition->allocated_format, &fmt);
+
+	if (frame.config->zero_copy && passthrough) {
+		Framebuffers::send(rendition, frame, frame.data,
+				   frame.linesize);
+
+		// NDI has moved on from the previous surface
+		if (held_slot >= 0)
+			Worker::release(rendition, held_slot);
+
+		held_slot = frame.slot;
+		return;
+	}
+
+	if (frame.linesize != rendition->stride &&
+	    frame.linesize >= rendition->row_bytes && passthrough)
+		Framebuffers::match_linesize(rendition, frame.linesize);
+
+	if (!Framebuffers::refill(rendition)) {
+		Worker::release(rendition, frame.slot);
+		rendition->frames_unbuffered++;
+		return;
+	}
+
+	auto buffer = rendition->frame_buffers.data(buffer_index);
+
+	Texture::copy(rendition, frame, buffer);
+
+	Worker::release(rendition, frame.slot);
+
+	Framebuffers::send(rendition, frame, buffer, rendition->stride);
+
+	// Just left zero copy mode
+	if (held_slot >= 0) {
+		Worker::release(rendition, held_slot);
+		held_slot = -1;
+	}
+
+	buffer_index =
+		(buffer_index + 1) % rendition->allocated_frame_buffer_count;
+}
+
+static void loop(void *data)
+{
+	auto rendition = (struct rendition *)data;
+
+	int32_t held_slot = -1;
+	uint32_t buffer_index = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(
+				rendition->worker_mutex);
+			rendition->worker_wake.wait(lock, [rendition] {
+				return rendition->worker_stop ||
+				       !rendition->work_queue.empty();
+			});
+		}
+
+		worker_frame frame;
+
+		if (!rendition->work_queue.pop(frame)) {
+			if (rendition->worker_stop)
+				break;
+			continue;
+		}
+
+		// Shutting down -- hand everything back unsent
+		if (rendition->worker_stop) {
+			Worker::release(rendition, frame.slot);
+			continue;
+		}
+
+		if (frame.config->backpressure == BACKPRESSURE_DROP_OLDEST) {
+			worker_frame newer;
 
-const NDIlib_v5 *ndi5_lib = nullptr;
+			while (rendition->work_queue.pop(newer)) {
+				Worker::release(rendition, frame.slot);
+				rendition->frames_dropped++;
+				frame = newer;
+			}
+		}
 
-namespace NDI5Filter {
+		Worker::send(rendition, frame, held_slot, buffer_index);
+	}
 
-static const char *filter_get_name(void *unused)
-{
-	UNUSED_PARAMETER(unused);
-	return obs_module_text(OBS_SETTING_UI_FILTER_NAME);
+	// NDI must let go of the last frame before the graphics thread unmaps it
+	Framebuffers::flush(rendition);
+
+	if (held_slot >= 0)
+		Worker::release(rendition, held_slot);
 }
 
-static bool filter_update_sender_name(obs_properties_t *, obs_property_t *,
-				      void *data)
+static void start(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	obs_data_t *settings = obs_source_get_settings(filter->context);
-	filter_update(filter, settings);
-	obs_data_release(settings);
-	return true;
+	if (rendition->worker_active)
+		return;
+
+	rendition->worker_stop = false;
+	rendition->worker = std::thread(Worker::loop, rendition);
+	rendition->worker_active = true;
 }
 
-static obs_properties_t *filter_properties(void *unused)
+// Must be called from inside the graphics context, released surfaces are
+// unmapped here
+static void stop(void *data)
 {
-	UNUSED_PARAMETER(unused);
+	auto rendition = (struct rendition *)data;
 
-	auto props = obs_properties_create();
+	if (!rendition->worker_active)
+		return;
 
-	obs_properties_set_flags(props, OBS_PROPERTIES_DEFER_UPDATE);
+	{
+		std::lock_guard<std::mutex> lock(rendition->worker_mutex);
+		rendition->worker_stop = true;
+	}
 
-	obs_properties_add_text(props, OBS_SETTING_UI_SENDER_NAME,
-				obs_module_text(OBS_SETTING_UI_SENDER_NAME),
-				OBS_TEXT_DEFAULT);
+	rendition->worker_wake.notify_one();
+	rendition->worker.join();
+	rendition->worker_active = false;
 
-	obs_properties_add_button(props, OBS_SETTING_UI_BUTTON_TITLE,
-				  obs_module_text(OBS_SETTING_UI_BUTTON_TITLE),
-				  filter_update_sender_name);
+	Staging::collect(rendition);
 
-	return props;
-}
+	// Staged but never mapped
+	std::ranges::fill(rendition->staging_state, STAGING_FREE);
 
-static void filter_defaults(obs_data_t *defaults)
-{
-	obs_data_set_default_string(
-		defaults, OBS_SETTING_UI_SENDER_NAME,
-		obs_module_text(OBS_SETTING_DEFAULT_SENDER_NAME));
+	if (rendition->frames_dropped)
+		debug("send worker dropped %llu frames",
+		      (unsigned long long)rendition->frames_dropped.load());
+
+	rendition->frames_dropped = 0;
 }
 
-namespace Textures {
+} // namespace Worker
 
-inline static void destroy(void *data)
+namespace Monitor {
+
+// Between polls -- NDI is never asked to wait itself, so Monitor::stop can
+// cut this short and its join returns at once. False once stopped.
+static bool wait(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	std::ranges::for_each(filter->staging_surface, gs_stagesurface_destroy);
-	std::ranges::for_each(filter->buffer_texture, gs_texture_destroy);
+	std::unique_lock<std::mutex> lock(rendition->monitor_mutex);
+
+	return !rendition->monitor_wake.wait_for(
+		lock, std::chrono::milliseconds(NDI_MONITOR_POLL_MS),
+		[rendition] { return rendition->monitor_stop; });
 }
 
-inline static void create(void *data, uint32_t width, uint32_t height)
+static void loop(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	for (auto &elm : filter->staging_surface)
-		elm = gs_stagesurface_create(width, height,
-					     filter->texture_format);
+	do {
+		// Replaced by a rename, no pass is still polling it
+		auto retired = rendition->retired_sender.exchange(nullptr);
 
-	for (auto &elm : filter->buffer_texture)
-		elm = gs_texture_create(width, height, filter->texture_format,
-					1, NULL, GS_RENDER_TARGET);
-}
+		if (retired)
+			ndi5_lib->send_destroy(retired);
 
-} // namespace Textures
+		const NDIlib_send_instance_t sender = rendition->ndi_sender;
+		const bool watched = rendition->connections > 0;
 
-namespace Framebuffers {
+		const int connections =
+			ndi5_lib->send_get_no_connections(sender, 0);
 
-// Forces NDI to process the previous frame, freeing the use of any memory we gave it
-inline static void flush(void *data)
+		if ((connections > 0) != watched)
+			debug("%d receivers connected", connections);
+
+		rendition->connections = connections;
+
+		// Video wall tiles keep us capturing too, they are only
+		// polled
+		Tiles::retire(rendition);
+
+		int tile_connections = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(rendition->tile_mutex);
+
+			for (uint32_t i = 0; i < rendition->tile_count; i++) {
+				auto tile = rendition->tiles[i].ndi_sender;
+
+				if (!tile)
+					continue;
+
+				tile_connections +=
+					ndi5_lib->send_get_no_connections(
+						tile, 0);
+			}
+		}
+
+		rendition->tile_connections = tile_connections;
+
+		NDIlib_tally_t tally = {};
+
+		if (connections > 0)
+			ndi5_lib->send_get_tally(sender, &tally, 0);
+
+		if (tally.on_program != rendition->on_program ||
+		    tally.on_preview != rendition->on_preview)
+			debug("tally program %d preview %d", tally.on_program,
+			      tally.on_preview);
+
+		rendition->on_program = tally.on_program;
+		rendition->on_preview = tally.on_preview;
+	} while (Monitor::wait(rendition));
+}
+
+static void start(void *data)
 {
-	auto filter = (struct filter *)data;
-	ndi5_lib->send_send_video_async_v2(filter->ndi_sender, NULL);
+	auto rendition = (struct rendition *)data;
+
+	if (rendition->monitor_active || !rendition->ndi_sender)
+		return;
+
+	rendition->monitor_stop = false;
+	rendition->monitor = std::thread(Monitor::loop, rendition);
+	rendition->monitor_active = true;
 }
 
-inline static void update_ndi_video_frame_desc(void *data, uint32_t width,
-					       uint32_t height, uint32_t depth)
+// Returns once the poll in progress is done, it never waits on NDI. The
+// sender is safe to destroy after.
+static void stop(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	if (!filter->first_run_update) {
-		filter->first_run_update = true;
-		filter->ndi_video_frame.frame_rate_D = 1000;
-		filter->ndi_video_frame.frame_rate_N = 60000;
-		filter->ndi_video_frame.picture_aspect_ratio = 1.778;
-		filter->ndi_video_frame.frame_format_type =
-			NDIlib_frame_format_type_e::
-				NDIlib_frame_format_type_progressive;
+	if (!rendition->monitor_active)
+		return;
 
-		// TODO allow format to change
-		filter->ndi_video_frame.FourCC = NDIlib_FourCC_type_RGBA;
+	{
+		std::lock_guard<std::mutex> lock(rendition->monitor_mutex);
+		rendition->monitor_stop = true;
 	}
 
-	// Update dimensions
-	filter->ndi_video_frame.xres = width;
-	filter->ndi_video_frame.yres = height;
+	rendition->monitor_wake.notify_one();
+	rendition->monitor.join();
+	rendition->monitor_active = false;
+
+	auto retired = rendition->retired_sender.exchange(nullptr);
 
-	// TODO allow depth change (this is everywhere depth is used)
-	filter->ndi_video_frame.line_stride_in_bytes = width * depth;
+	if (retired)
+		ndi5_lib->send_destroy(retired);
+
+	Tiles::retire(rendition);
 }
 
-inline static void destroy(void *data)
+// True while nobody is watching and there is no point capturing, each frame
+// skipped is counted once. Whatever was staged before going idle is dropped
+// on the way out so the first frame sent is a fresh one.
+static bool idle(void *data)
 {
-	auto filter = (struct filter *)data;
-	std::ranges::for_each(filter->ndi_frame_buffers,
-			      [](auto &ptr) { bfree(ptr); });
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	if (!Monitor::unwatched(rendition)) {
+		if (rendition->idling) {
+			Staging::discard(rendition);
+			rendition->idling = false;
+		}
+		return false;
+	}
+
+	rendition->idling = true;
+
+	if (rendition->idle_frame != filter->frame_count) {
+		rendition->idle_frame = filter->frame_count;
+		rendition->frames_idle++;
+	}
+
+	return true;
 }
 
-inline static void create(void *data, uint32_t width, uint32_t height,
-			  uint32_t depth)
+// Idling is on and no receiver is connected, to the sender or a tile
+static bool unwatched(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	if (filter->frame_allocated) {
-		warn("NDI5 frame buffers destroyed unexpectedly");
-		Framebuffers::destroy(filter);
+	return rendition->filter->config->idle_unwatched &&
+	       rendition->connections == 0 && rendition->tile_connections == 0;
+}
+
+} // namespace Monitor
+
+namespace Rename {
+
+// rename_thread -- NDI announces the new name before send_create returns,
+// which can take a while
+static void create(void *data, std::string name)
+{
+	auto rendition = (struct rendition *)data;
+
+	auto sender = Sender::create(ndi5_lib, name.c_str());
+
+	if (!sender) {
+		error("could not create ndi sender '%s'", name.c_str());
+		rendition->rename_busy = false;
+		return;
 	}
 
-	// Create the frame buffers
-	std::ranges::for_each(filter->ndi_frame_buffers, [width, height,
-							  depth](auto &ptr) {
-		ptr = static_cast<uint8_t *>(bzalloc(width * height * depth));
-	});
-	filter->frame_allocated = true;
+	NDIlib_send_instance_t stale;
 
-	// Update NDI5 ndi_video_frame desc
-	update_ndi_video_frame_desc(filter, width, height, depth);
-}
+	{
+		std::lock_guard<std::mutex> lock(rendition->rename_mutex);
 
-} // namespace Framebuffers
+		stale = rendition->renamed_sender;
+		rendition->renamed_sender = sender;
+		rendition->renamed_name = name;
+		rendition->rename_ready = true;
+	}
 
-namespace Texture {
+	// Renamed again before the last one was swapped in, nothing was sent
+	// on it
+	if (stale)
+		ndi5_lib->send_destroy(stale);
+
+	rendition->rename_busy = false;
+}
 
-static void reset(void *data, uint32_t width, uint32_t height)
+// filter_video_tick -- one rename in flight at a time, a name asked for in the
+// meantime is picked up on a later frame. Never waits on NDI.
+static void request(void *data, const std::string &name)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	// Update Texture data
-	filter->width = width;
-	filter->height = height;
-	filter->size = width * height * filter->depth;
+	if (name == rendition->rename_name || rendition->rename_busy)
+		return;
 
-	// Texture buffers
-	Textures::destroy(filter);
-	Textures::create(filter, width, height);
+	// Already finished, this returns straight away
+	if (rendition->rename_thread.joinable())
+		rendition->rename_thread.join();
 
-	// NDI frame buffers
-	Framebuffers::flush(filter);
-	Framebuffers::destroy(filter);
-	Framebuffers::create(filter, width, height, filter->depth);
+	rendition->rename_name = name;
+	rendition->rename_busy = true;
+	rendition->rename_thread = std::thread(Rename::create, rendition, name);
+}
 
-	// Destroy the NDI5 sender
-	if (filter->sender_created)
-		ndi5_lib->send_destroy(filter->ndi_sender);
+// filter_video_tick -- puts a renamed sender in place of the current one, no
+// buffer is touched. Ahead of the idle gate so a sender nobody watches is
+// renamed too. Waits a frame if the monitor has yet to destroy the last one
+// it replaced.
+static void swap(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
 
-	// Setup the new NDI5 stream
-	NDIlib_send_create_t desc;
-	desc.p_ndi_name = filter->sender_name.c_str();
-	desc.clock_video = false;
+	if (!rendition->rename_ready || !rendition->sender_created ||
+	    rendition->retired_sender)
+		return;
 
-	filter->ndi_sender = ndi5_lib->send_create(&desc);
+	const uint64_t start = os_gettime_ns();
 
-	if (!filter->ndi_sender) {
-		error("could not create ndi sender");
+	NDIlib_send_instance_t sender;
+	std::string name;
+
+	{
+		std::lock_guard<std::mutex> lock(rendition->rename_mutex);
+
+		sender = rendition->renamed_sender;
+		name = std::move(rendition->renamed_name);
+		rendition->renamed_sender = nullptr;
+		rendition->rename_ready = false;
 	}
 
-	filter->sender_created = true;
+	// Nothing may send on the old sender past here, the tick is outside
+	// the graphics context
+	obs_enter_graphics();
+	Worker::stop(rendition);
+	obs_leave_graphics();
+
+	// NDI must let go of the last frame it was given
+	ndi5_lib->send_send_video_async_v2(rendition->ndi_sender, NULL);
+
+	auto old = rendition->ndi_sender.exchange(sender);
+	rendition->sender_name = name;
+
+	if (rendition->monitor_active)
+		rendition->retired_sender = old;
+	else
+		ndi5_lib->send_destroy(old);
+
+	if (filter->config->threaded)
+		Worker::start(rendition);
+
+	info("'%s' renamed, graphics thread held for %.2f ms", name.c_str(),
+	     (os_gettime_ns() - start) / 1000000.0);
 }
 
-// Returns a std::pair with previous and next buffer indexes
-static std::pair<int, int> calculate_buffer_indexes(void *data)
+// filter_destroy -- a rename still in flight is waited for and dropped
+static void finish(void *data)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
 
-	uint32_t prev_buffer_index = filter->buffer_index == 0
-					     ? NDI_BUFFER_MAX
-					     : filter->buffer_index - 1;
+	if (rendition->rename_thread.joinable())
+		rendition->rename_thread.join();
 
-	uint32_t next_buffer_index = filter->buffer_index == NDI_BUFFER_MAX
-					     ? 0
-					     : filter->buffer_index + 1;
+	if (rendition->renamed_sender)
+		ndi5_lib->send_destroy(rendition->renamed_sender);
 
-	return std::make_pair(prev_buffer_index, next_buffer_index);
+	rendition->renamed_sender = nullptr;
+	rendition->rename_ready = false;
 }
 
-static void render(void *data, obs_source_t *target, uint32_t cx, uint32_t cy)
+} // namespace Rename
+
+namespace Pacing {
+
+// Target rate as a fraction of the OBS rate, before reducing
+static void target(void *data, const struct obs_video_info &ovi,
+		   uint64_t *num, uint64_t *den)
 {
-	auto filter = (struct filter *)data;
+	auto rendition = (struct rendition *)data;
+	auto config = rendition->filter->config.get();
+
+	*num = ovi.fps_num;
+	*den = ovi.fps_den;
+
+	if (config->frame_rate < 0) {
+		*den *= (uint64_t)-config->frame_rate;
+	} else if (config->frame_rate > 0 &&
+		   (uint64_t)config->frame_rate * ovi.fps_den < ovi.fps_num) {
+		const uint64_t fps = (uint64_t)config->frame_rate;
+
+		// Close enough to every Nth frame -- keep the exact OBS rational
+		const uint64_t every = (ovi.fps_num + fps * ovi.fps_den / 2) /
+				       (fps * ovi.fps_den);
+		const uint64_t snapped = ovi.fps_den * every;
+		const uint64_t error =
+			(uint64_t)std::llabs((long long)(ovi.fps_num * 1000) -
+					     (long long)(fps * snapped * 1000));
+
+		if (every > 1 &&
+		    error <= fps * snapped * NDI_FRAME_RATE_SNAP_PERMILLE) {
+			*den = snapped;
+		} else {
+			*num = fps;
+			*den = 1;
+		}
+	}
 
-	if (filter->width != cx || filter->height != cy)
-		Texture::reset(filter, cx, cy);
+	*den *= rendition->tally.rate();
+}
 
-	auto [prev_buffer_index, next_buffer_index] =
-		calculate_buffer_indexes(filter);
+// The rate NDI is told about, as a reduced fraction
+inline static void advertise(void *data, uint64_t num, uint64_t den)
+{
+	auto rendition = (struct rendition *)data;
 
-	gs_viewport_push();
-	gs_projection_push();
-	gs_matrix_push();
-	gs_matrix_identity();
+	const uint64_t divisor = std::gcd(num, den);
 
-	filter->prev_target = gs_get_render_target();
-	filter->prev_space = gs_get_color_space();
+	rendition->frame_rate_N = (int32_t)(num / divisor);
+	rendition->frame_rate_D = (int32_t)(den / divisor);
+}
 
-	// RENDER THE CURRENT FRAME
-	gs_set_render_target_with_color_space(
-		filter->buffer_texture[filter->buffer_index], NULL, GS_CS_SRGB);
+// Starts over from the current OBS rate, the first frame is always captured
+static void reset(void *data)
+{
+	auto rendition = (struct rendition *)data;
 
-	gs_set_viewport(0, 0, filter->width, filter->height);
+	rendition->pace_credit = 0;
+	rendition->frame_due = true;
 
-	struct vec4 background;
+	struct obs_video_info ovi;
 
-	vec4_zero(&background);
+	if (!obs_get_video_info(&ovi) || !ovi.fps_num || !ovi.fps_den)
+		return;
 
-	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
-	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+	uint64_t num, den;
+	Pacing::target(rendition, ovi, &num, &den);
+	Pacing::advertise(rendition, num, den);
+}
 
-	gs_blend_state_push();
-	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+// Once per OBS frame -- decides whether this frame is captured, spreading the
+// captured ones evenly when the target is not a whole divisor
+static void tick(void *data)
+{
+	auto rendition = (struct rendition *)data;
 
-	obs_source_video_render(target);
+	struct obs_video_info ovi;
 
-	gs_blend_state_pop();
+	if (!obs_get_video_info(&ovi) || !ovi.fps_num || !ovi.fps_den) {
+		rendition->frame_due = true;
+		return;
+	}
 
-	gs_set_render_target_with_color_space(filter->prev_target, NULL,
-					      filter->prev_space);
+	uint64_t num, den;
+	Pacing::target(rendition, ovi, &num, &den);
 
-	gs_matrix_pop();
-	gs_projection_pop();
-	gs_viewport_pop();
+	// Captured frames per OBS frame is (num / den) / (fps_num / fps_den)
+	const uint64_t step = num * ovi.fps_den;
+	const uint64_t threshold = den * ovi.fps_num;
 
-	// MAP THE PREVIOUS FRAME
-	if (gs_stagesurface_map(filter->staging_surface[prev_buffer_index],
-				&filter->texture_data, &filter->linesize)) {
+	rendition->pace_credit += step;
+	rendition->frame_due = rendition->pace_credit >= threshold;
 
-		memcpy(&filter->ndi_frame_buffers[filter->buffer_index][0],
-		       filter->texture_data, filter->size);
+	if (rendition->frame_due)
+		rendition->pace_credit = (rendition->pace_credit - threshold) %
+				      threshold;
 
-		gs_stagesurface_unmap(
-			filter->staging_surface[prev_buffer_index]);
+	Pacing::advertise(rendition, num, den);
+}
+
+// True on the frames the output rate leaves out, counted once each
+static bool skip(void *data)
+{
+	auto rendition = (struct rendition *)data;
+	auto filter = rendition->filter;
+
+	if (rendition->frame_due)
+		return false;
+
+	if (rendition->decimated_frame != filter->frame_count) {
+		rendition->decimated_frame = filter->frame_count;
+		rendition->frames_decimated++;
 	}
 
-#ifdef USE_CURRENT_FRAME
-	// Sets the NDI5 frame data to the same memory we just copied above
-	filter->ndi_video_frame.p_data =
-		filter->ndi_frame_buffers[filter->buffer_index];
-#else
-	// SET THE NEXT FRAME
-	// If this was the very first frame, it wont'get actually get rendered
-	// until frame buffer_count+1
-	filter->ndi_video_frame.p_data =
-		filter->ndi_frame_buffers[next_buffer_index];
+	return true;
+}
 
-#endif
-	ndi5_lib->send_send_video_async_v2(filter->ndi_sender,
-					   &filter->ndi_video_frame);
+} // namespace Pacing
 
-#ifdef USE_CURRENT_FRAME
-	// STAGE THE NEXT FRAME
-	// Use the current texture render inside this call
-	gs_stage_texture(filter->staging_surface[filter->buffer_index],
-			 filter->buffer_texture[filter->buffer_index]);
-#else
-	// STAGE THE NEXT FRAME
-	gs_stage_texture(filter->staging_surface[filter->buffer_index],
-			 filter->buffer_texture[prev_buffer_index]);
-#endif
+namespace Status {
+
+// filter_video_tick -- what the last frame left behind, a new snapshot only
+// when some of it changed so a steady stream allocates nothing
+static void publish(void *data)
+{
+	auto rendition = (struct rendition *)data;
 
-	filter->buffer_index = next_buffer_index;
+	struct rendition_status status = {};
+	status.sender_created = rendition->sender_created;
+	status.staging_depth = rendition->staging.depth();
+	status.staging_count = rendition->allocated_staging_count;
+	status.width = rendition->width;
+	status.height = rendition->height;
+	status.frame_rate_N = rendition->frame_rate_N;
+	status.frame_rate_D = rendition->frame_rate_D;
+	status.tile_count = rendition->tile_count;
 
-	return;
+	uint64_t buffers;
+	pool_memory(rendition, &status.texture_bytes, &status.staging_bytes,
+		    &buffers);
+
+	auto shown = rendition->status.load();
+
+	if (shown && *shown == status)
+		return;
+
+	rendition->status.publish(
+		std::make_shared<const struct rendition_status>(status));
 }
 
-} // namespace Texture
+} // namespace Status
 
 static void filter_render_callback(void *data, uint32_t cx, uint32_t cy)
 {
@@ -306,6 +3224,22 @@ static void filter_render_callback(void *data, uint32_t cx, uint32_t cy)
 	if (!filter->context)
 		return;
 
+	// Already captured this frame
+	if (filter->captured_frame == filter->frame_count)
+		return;
+
+	if (filter->config->capture_mode == CAPTURE_MODE_FILTER)
+		return;
+
+	if (Texture::skip(filter))
+		return;
+
+	// The filter chain is being drawn -- the filter may simply not have
+	// been drawn yet this frame (previews and projectors render after us)
+	if (filter->config->capture_mode == CAPTURE_MODE_AUTO &&
+	    filter->frame_count - filter->filter_drawn_frame <= 1)
+		return;
+
 	auto target = obs_filter_get_parent(filter->context);
 
 	if (!target)
@@ -323,60 +3257,235 @@ static void filter_render_callback(void *data, uint32_t cx, uint32_t cy)
 
 static void filter_update(void *data, obs_data_t *settings)
 {
-	UNUSED_PARAMETER(settings);
-
 	auto filter = (struct filter *)data;
 
-	obs_remove_main_render_callback(filter_render_callback, filter);
+	// Built off to the side and published whole, the render path keeps the
+	// one it has until its next frame
+	auto config = std::make_shared<struct config>();
+
+	config->version = ++filter->config_version;
+
+	config->capture_mode = (uint32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_CAPTURE_MODE);
+	config->color_matrix = (uint32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_COLOR_MATRIX);
+	config->color_range = (uint32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_COLOR_RANGE);
+	config->streaming_readback = obs_data_get_bool(
+		settings, OBS_SETTING_UI_STREAMING_READBACK);
+	config->zero_copy =
+		obs_data_get_bool(settings, OBS_SETTING_UI_ZERO_COPY);
+	config->backpressure = (uint32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_BACKPRESSURE);
+
+	// Picked up by Staging::adapt on the next frame
+	auto staging_depth = [settings](const char *name) {
+		return (uint32_t)std::clamp(
+			obs_data_get_int(settings, name),
+			(long long)NDI_STAGING_DEPTH_MIN,
+			(long long)NDI_STAGING_DEPTH_MAX);
+	};
+
+	config->staging.adaptive =
+		obs_data_get_bool(settings, OBS_SETTING_UI_ADAPTIVE_STAGING);
+	config->staging.fixed = staging_depth(OBS_SETTING_UI_STAGING_DEPTH);
+	config->staging.min = staging_depth(OBS_SETTING_UI_STAGING_DEPTH_MIN);
+	config->staging.max =
+		std::max(staging_depth(OBS_SETTING_UI_STAGING_DEPTH_MAX),
+			 config->staging.min);
+	config->staging.stall_ns =
+		(uint64_t)obs_data_get_int(settings,
+					   OBS_SETTING_UI_STALL_THRESHOLD) *
+		1000;
+	config->low_latency =
+		obs_data_get_bool(settings, OBS_SETTING_UI_LOW_LATENCY);
+
+	// Picked up by Texture::prepare on the next frame, no new sender needed
+	config->frame_buffer_count = (uint32_t)std::clamp(
+		obs_data_get_int(settings, OBS_SETTING_UI_FRAME_BUFFER_COUNT),
+		(long long)NDI_FRAME_BUFFER_COUNT_MIN,
+		(long long)NDI_BUFFER_COUNT);
+	config->coefficients = Kernels::make_coefficients(
+		config->color_matrix == COLOR_MATRIX_601,
+		config->color_range == COLOR_RANGE_FULL);
+
+	// Picked up by Texture::prepare on the next frame
+	auto output_format = (uint32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_OUTPUT_FORMAT);
+
+	if (output_format == OUTPUT_FORMAT_UYVY_GPU && !filter->uyvy_effect) {
+		warn("UYVY conversion effect unavailable, sending RGBA");
+		output_format = OUTPUT_FORMAT_RGBA;
+	}
 
-	// If our names have changed, rebuild NDI
-	if (strcmp(filter->setting_sender_name, filter->sender_name.c_str()) !=
-	    0) {
-		obs_enter_graphics();
+	config->output_format = output_format;
+
+	// Picked up by Texture::prepare as a rescale, the sender is kept.
+	// Switching a proxy on or off is picked up there too, and so is a new
+	// sender name.
+	for (uint32_t index = 0; index < NDI_RENDITION_COUNT; index++) {
+		auto enabled = rendition_key(OBS_SETTING_UI_RENDITION, index);
+		auto output_size =
+			rendition_key(OBS_SETTING_UI_OUTPUT_SIZE, index);
+
+		config->enabled[index] =
+			!index || obs_data_get_bool(settings, enabled.c_str());
+		config->output_size[index] = (uint32_t)obs_data_get_int(
+			settings, output_size.c_str());
+		config->sender_name[index] = rendition_name(settings, index);
+	}
 
-		// HACK -- tell the render engine we have no frames allocated
-		filter->frame_allocated = false;
+	config->scaler =
+		(uint32_t)obs_data_get_int(settings, OBS_SETTING_UI_SCALER);
+
+	// Picked up by Texture::prepare, a new canvas size rebuilds once
+	const bool canvas = obs_data_get_bool(settings, OBS_SETTING_UI_CANVAS);
+
+	config->canvas_width =
+		canvas ? (uint32_t)obs_data_get_int(settings,
+						    OBS_SETTING_UI_CANVAS_WIDTH)
+		       : 0;
+	config->canvas_height =
+		canvas ? (uint32_t)obs_data_get_int(
+				 settings, OBS_SETTING_UI_CANVAS_HEIGHT)
+		       : 0;
+
+	config->resize_hold = (uint32_t)std::clamp(
+		obs_data_get_int(settings, OBS_SETTING_UI_RESIZE_HOLD), 0ll,
+		(long long)NDI_RESIZE_HOLD_MAX);
+
+	// Picked up by Texture::prepare as well
+	config->threaded =
+		obs_data_get_bool(settings, OBS_SETTING_UI_THREADED_SEND);
+
+	config->idle_unwatched =
+		obs_data_get_bool(settings, OBS_SETTING_UI_IDLE_UNWATCHED);
+
+	// Picked up by Pacing::tick on the next frame
+	config->frame_rate = (int32_t)obs_data_get_int(
+		settings, OBS_SETTING_UI_FRAME_RATE);
+
+	// Picked up by Texture::prepare and Pacing::tick on the next frame
+	config->tally.throttle =
+		obs_data_get_bool(settings, OBS_SETTING_UI_TALLY_THROTTLE);
+	config->tally.rate = (uint32_t)std::clamp(
+		obs_data_get_int(settings, OBS_SETTING_UI_TALLY_RATE), 1ll,
+		(long long)NDI_TALLY_RATE_MAX);
+	config->tally.scale = (uint32_t)std::clamp(
+		obs_data_get_int(settings, OBS_SETTING_UI_TALLY_SCALE), 1ll,
+		(long long)NDI_TALLY_SCALE_MAX);
+	config->tally.hold = NDI_TALLY_HOLD;
+
+	// Picked up by Tiles::request on the next frame. One "x,y,width,height"
+	// string per tile.
+	config->tile_rect_count = 0;
+
+	auto tile_list = obs_data_get_array(settings, OBS_SETTING_UI_TILE_LIST);
+
+	for (size_t i = 0; i < obs_data_array_count(tile_list); i++) {
+		auto item = obs_data_array_item(tile_list, i);
+		auto value = obs_data_get_string(item, "value");
+
+		tile_rect rect;
+
+		if (config->tile_rect_count < NDI_TILE_COUNT &&
+		    sscanf(value, "%u , %u , %u , %u", &rect.x, &rect.y,
+			   &rect.width, &rect.height) == 4 &&
+		    rect.width && rect.height)
+			config->tile_rects[config->tile_rect_count++] = rect;
+		else
+			warn("ignoring video wall tile '%s'", value);
+
+		obs_data_release(item);
+	}
 
-		// Change current sender
-		filter->sender_name = std::string(filter->setting_sender_name);
+	obs_data_array_release(tile_list);
 
-		// Reset all the buffers -- this causes some dropped frames I think
-		// TODO Check this out at some point
-		Texture::reset(filter, filter->width, filter->height);
+	config->tiling = obs_data_get_bool(settings, OBS_SETTING_UI_TILES);
 
-		obs_leave_graphics();
-	}
+	if (config->tiling && !Tiles::sliceable(config->output_format))
+		warn("video wall tiles need a single plane output format");
 
-	obs_add_main_render_callback(filter_render_callback, filter);
+	filter->published.publish(std::move(config));
 }
 
 static void *filter_create(obs_data_t *settings, obs_source_t *source)
 {
-	auto filter = (struct filter *)bzalloc(sizeof(NDI5Filter::filter));
+	// Not bzalloc -- the worker thread members need constructing
+	auto filter = new NDI5Filter::filter();
 
 	// Baseline everything
 	filter->texture_format = OBS_PLUGIN_COLOR_SPACE;
-	filter->buffer_index = 0;
-	filter->width = 0;
-	filter->height = 0;
-	filter->frame_allocated = false;
-	filter->sender_created = false;
+	filter->source_width = 0;
+	filter->source_height = 0;
+	filter->content_width = 0;
+	filter->content_height = 0;
+	filter->canvas = false;
+	filter->pending_frames = 0;
+	filter->pending_frame = 0;
+	filter->captured_texture = nullptr;
+	filter->capture_texture = nullptr;
+	filter->kernels = Kernels::detect();
+
+	for (uint32_t i = 0; i < NDI_RENDITION_COUNT; i++) {
+		auto &rendition = filter->renditions[i];
+
+		rendition.filter = filter;
+		rendition.index = i;
+		rendition.width = 0;
+		rendition.height = 0;
+		rendition.frame_refused = false;
+		rendition.sender_created = false;
+		rendition.allocated_format = OUTPUT_FORMAT_RGBA;
+		rendition.worker_active = false;
+		rendition.held_slot = -1;
+		rendition.monitor_active = false;
+		rendition.renamed_sender = nullptr;
+		rendition.rename_ready = false;
+		rendition.rename_busy = false;
+		rendition.retired_sender = nullptr;
+		// Watched until the monitor says otherwise
+		rendition.connections = 1;
+		rendition.tile_count = 0;
+		rendition.tile_connections = 0;
+		rendition.tile_busy = false;
+		rendition.tile_ready = false;
+		rendition.tile_retired_count = 0;
+		rendition.tile_request_count = 0;
+
+		// Bytes per pixel of RGBA, Texture::frame_layout sets the
+		// output format's before anything is sent
+		rendition.depth = 4;
+	}
+
+	// Conversion effect for GPU side packing
+	char *effect_path = obs_module_file(OBS_PLUGIN_UYVY_EFFECT);
+
+	obs_enter_graphics();
+	filter->uyvy_effect = gs_effect_create_from_file(effect_path, NULL);
+	obs_leave_graphics();
+
+	bfree(effect_path);
 
-	// TODO undevtest this variable
-	filter->depth = 4;
+	if (!filter->uyvy_effect)
+		warn("could not load %s", OBS_PLUGIN_UYVY_EFFECT);
 
 	// Setup the obs context
 	filter->context = source;
 
-	// setup the ui setting
-	filter->setting_sender_name =
-		obs_data_get_string(settings, OBS_SETTING_UI_SENDER_NAME);
+	// force an update, which also names every sender
+	filter_update(filter, settings);
 
-	// Copy it to our sendername
-	filter->sender_name = std::string(filter->setting_sender_name);
+	filter->config = filter->published.load();
 
-	// force an update
-	filter_update(filter, settings);
+	for (auto &rendition : filter->renditions) {
+		Pacing::reset(&rendition);
+
+		// Adaptive staging starts out from the fixed depth
+		rendition.staging.reset(filter->config->staging);
+	}
+
+	obs_add_main_render_callback(filter_render_callback, filter);
 
 	return filter;
 }
@@ -393,25 +3502,58 @@ static void filter_destroy(void *data)
 	// Cleanup OBS stuff
 	obs_enter_graphics();
 
-	Textures::destroy(filter);
+	for (auto &rendition : filter->renditions) {
+		// Nothing else may send on this sender once the worker is gone
+		Worker::stop(&rendition);
+
+		// Flush NDI -- it may still be reading a mapped staging surface
+		Framebuffers::flush(&rendition);
+
+		Textures::destroy(&rendition);
+
+		Staging::reset_latency(&rendition);
+	}
+
+	gs_texture_destroy(filter->capture_texture);
+	filter->capture_texture = nullptr;
+
+	gs_effect_destroy(filter->uyvy_effect);
 
 	obs_leave_graphics();
 
-	// Flush NDI
-	Framebuffers::flush(filter);
+	for (auto &rendition : filter->renditions) {
+		Rename::finish(&rendition);
+		Monitor::stop(&rendition);
+
+		Tiles::finish(&rendition);
 
-	// Destroy sender
-	if (filter->sender_created)
-		ndi5_lib->send_destroy(filter->ndi_sender);
+		if (rendition.frames_idle)
+			debug("'%s' skipped %llu frames with no receivers",
+			      rendition.sender_name.c_str(),
+			      (unsigned long long)rendition.frames_idle.load());
 
-	// Destroy any framebuffers
-	Framebuffers::destroy(filter);
+		if (rendition.frames_decimated)
+			debug("'%s' skipped %llu frames to hold the output frame rate",
+			      rendition.sender_name.c_str(),
+			      (unsigned long long)
+				      rendition.frames_decimated.load());
+
+		// Destroy sender
+		if (rendition.sender_created)
+			ndi5_lib->send_destroy(rendition.ndi_sender);
+
+		// Destroy any framebuffers
+		Framebuffers::destroy(&rendition);
+	}
+
+	// Spares sized for this filter are unlikely to suit another
+	ndi5_frame_pool->trim();
 
 	// ...
-	filter->texture_data = nullptr;
 	filter->prev_target = nullptr;
+	filter->captured_texture = nullptr;
 
-	bfree(filter);
+	delete filter;
 }
 
 static void filter_video_render(void *data, gs_effect_t *effect)
@@ -423,7 +3565,51 @@ static void filter_video_render(void *data, gs_effect_t *effect)
 	if (!filter->context)
 		return;
 
-	obs_source_skip_video_filter(filter->context);
+	if (filter->config->capture_mode == CAPTURE_MODE_PARENT) {
+		obs_source_skip_video_filter(filter->context);
+		return;
+	}
+
+	auto target = obs_filter_get_target(filter->context);
+
+	if (!target) {
+		obs_source_skip_video_filter(filter->context);
+		return;
+	}
+
+	auto target_width = obs_source_get_base_width(target);
+	auto target_height = obs_source_get_base_height(target);
+
+	if (target_width == 0 || target_height == 0) {
+		obs_source_skip_video_filter(filter->context);
+		return;
+	}
+
+	filter->filter_drawn_frame = filter->frame_count;
+
+	// Drawn more than once this frame (multiple views) -- reuse our capture
+	if (filter->filter_captured_frame == filter->frame_count &&
+	    filter->captured_texture &&
+	    filter->content_width == target_width &&
+	    filter->content_height == target_height) {
+		Texture::draw(filter->captured_texture, target_width,
+			      target_height);
+		return;
+	}
+
+	// The parent was already rendered for us this frame
+	if (filter->captured_frame == filter->frame_count) {
+		obs_source_skip_video_filter(filter->context);
+		return;
+	}
+
+	if (Texture::skip(filter)) {
+		obs_source_skip_video_filter(filter->context);
+		return;
+	}
+
+	if (!Texture::capture(filter, target_width, target_height))
+		obs_source_skip_video_filter(filter->context);
 }
 
 static void filter_video_tick(void *data, float seconds)
@@ -431,6 +3617,74 @@ static void filter_video_tick(void *data, float seconds)
 	UNUSED_PARAMETER(seconds);
 	auto filter = (struct filter *)data;
 	filter->frame_count++;
+
+	// Everything rendered this frame sees the same settings
+	if (filter->published.take(filter->config))
+		debug("settings version %llu",
+		      (unsigned long long)filter->config->version);
+
+	filter->capture_bytes =
+		filter->capture_texture
+			? (uint64_t)Resize::bucket(filter->content_width) *
+				  Resize::bucket(filter->content_height) * 4
+			: 0;
+
+	// Renamed whether or not anything is captured this frame
+	for (auto &rendition : filter->renditions) {
+		if (rendition.sender_created &&
+		    filter->config->enabled[rendition.index])
+			Rename::request(
+				&rendition,
+				filter->config->sender_name[rendition.index]);
+
+		Rename::swap(&rendition);
+
+		// One tally for the whole frame, pacing and sizing agree on it
+		rendition.tally.update(rendition.on_program,
+				       rendition.on_preview,
+				       filter->config->tally);
+		Pacing::tick(&rendition);
+
+		// Named after the sender, so after any rename
+		if (!rendition.index) {
+			Tiles::request(&rendition);
+			Tiles::swap(&rendition);
+		}
+
+		// Here rather than behind the idle gate, a hidden source never
+		// gets that far
+		if (Monitor::unwatched(&rendition))
+			Framebuffers::evict(&rendition);
+
+		Status::publish(&rendition);
+	}
+}
+
+// Shared by every filter, its cap comes from the module's own config
+void create_frame_pool()
+{
+	ndi5_frame_pool = std::make_unique<Buffers::pool>();
+
+	char *path = obs_module_config_path(OBS_PLUGIN_CONFIG_FILE);
+	obs_data_t *module_config =
+		obs_data_create_from_json_file_safe(path, "bak");
+	bfree(path);
+
+	long long cap_mb = NDI_FRAME_POOL_CAP_DEFAULT_MB;
+
+	if (module_config) {
+		obs_data_set_default_int(module_config,
+					 OBS_SETTING_UI_BUFFER_POOL_CAP,
+					 NDI_FRAME_POOL_CAP_DEFAULT_MB);
+		cap_mb = obs_data_get_int(module_config,
+					  OBS_SETTING_UI_BUFFER_POOL_CAP);
+		obs_data_release(module_config);
+	}
+
+	ndi5_frame_pool->set_cap((uint64_t)cap_mb * 1048576);
+
+	if (cap_mb)
+		info("frame buffers of all filters capped at %lld MB", cap_mb);
 }
 
 // Writes a simple log entry to OBS
@@ -493,6 +3747,8 @@ bool obs_module_load(void)
 
 	NDI5Filter::report_version();
 
+	NDI5Filter::create_frame_pool();
+
 	ndi5_lib = load_ndi5_lib();
 
 	if (!ndi5_lib) {
@@ -506,12 +3762,16 @@ bool obs_module_load(void)
 	}
 
 	info("NDI5 (%s) IS READY TO ROCK", ndi5_lib->version());
+	info("pixel kernels: %s", NDI5Filter::Kernels::detect()->name);
 
 	return true;
 }
 
 void obs_module_unload()
 {
+	// Every filter is gone, so is every block it held
+	ndi5_frame_pool.reset();
+
 	if (ndi5_lib)
 		ndi5_lib->destroy();
 
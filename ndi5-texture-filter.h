@@ -5,10 +5,17 @@
 #endif
 #include <Windows.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <memory>
 #include <atomic>
 #include <string>
 #include <ranges>
+#include <numeric>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 #include <obs-module.h>
 #include <graphics/graphics.h>
@@ -20,6 +27,15 @@
 
 #include "inc/Processing.NDI.Lib.h"
 
+#include "ndi5-buffer-pool.h"
+#include "ndi5-pixel-kernels.h"
+#include "ndi5-resize.h"
+#include "ndi5-sender.h"
+#include "ndi5-snapshot.h"
+#include "ndi5-spsc-queue.h"
+#include "ndi5-staging-depth.h"
+#include "ndi5-tally.h"
+
 /* clang-format off */
 
 #define OBS_PLUGIN                         "obs-ndi5-filter"
@@ -38,10 +54,336 @@
 #define OBS_SETTING_UI_BUTTON_TITLE        "mahgu.ndi5texture.ui.button_title"
 #define OBS_SETTING_DEFAULT_SENDER_NAME    "mahgu.ndi5texture.default.sender_name"
 
+#define OBS_SETTING_UI_CAPTURE_MODE        "mahgu.ndi5texture.ui.capture_mode"
+#define OBS_SETTING_UI_CAPTURE_AUTO        "mahgu.ndi5texture.ui.capture_mode.auto"
+#define OBS_SETTING_UI_CAPTURE_FILTER      "mahgu.ndi5texture.ui.capture_mode.filter"
+#define OBS_SETTING_UI_CAPTURE_PARENT      "mahgu.ndi5texture.ui.capture_mode.parent"
+
+#define OBS_SETTING_UI_OUTPUT_FORMAT       "mahgu.ndi5texture.ui.output_format"
+#define OBS_SETTING_UI_FORMAT_RGBA         "mahgu.ndi5texture.ui.output_format.rgba"
+#define OBS_SETTING_UI_FORMAT_UYVY_GPU     "mahgu.ndi5texture.ui.output_format.uyvy_gpu"
+#define OBS_SETTING_UI_FORMAT_UYVY_CPU     "mahgu.ndi5texture.ui.output_format.uyvy_cpu"
+#define OBS_SETTING_UI_FORMAT_UYVA_CPU     "mahgu.ndi5texture.ui.output_format.uyva_cpu"
+#define OBS_SETTING_UI_FORMAT_BGRX_CPU     "mahgu.ndi5texture.ui.output_format.bgrx_cpu"
+#define OBS_SETTING_UI_FORMAT_NV12_CPU     "mahgu.ndi5texture.ui.output_format.nv12_cpu"
+#define OBS_SETTING_UI_STREAMING_READBACK  "mahgu.ndi5texture.ui.streaming_readback"
+#define OBS_SETTING_UI_ZERO_COPY           "mahgu.ndi5texture.ui.zero_copy"
+#define OBS_SETTING_UI_COLOR_MATRIX        "mahgu.ndi5texture.ui.color_matrix"
+#define OBS_SETTING_UI_COLOR_MATRIX_709    "mahgu.ndi5texture.ui.color_matrix.709"
+#define OBS_SETTING_UI_COLOR_MATRIX_601    "mahgu.ndi5texture.ui.color_matrix.601"
+#define OBS_SETTING_UI_COLOR_RANGE         "mahgu.ndi5texture.ui.color_range"
+#define OBS_SETTING_UI_COLOR_RANGE_PARTIAL "mahgu.ndi5texture.ui.color_range.partial"
+#define OBS_SETTING_UI_COLOR_RANGE_FULL    "mahgu.ndi5texture.ui.color_range.full"
+#define OBS_SETTING_UI_THREADED_SEND       "mahgu.ndi5texture.ui.threaded_send"
+#define OBS_SETTING_UI_BACKPRESSURE        "mahgu.ndi5texture.ui.backpressure"
+#define OBS_SETTING_UI_BACKPRESSURE_OLDEST "mahgu.ndi5texture.ui.backpressure.drop_oldest"
+#define OBS_SETTING_UI_BACKPRESSURE_NEWEST "mahgu.ndi5texture.ui.backpressure.drop_newest"
+#define OBS_SETTING_UI_BACKPRESSURE_BLOCK  "mahgu.ndi5texture.ui.backpressure.block"
+#define OBS_SETTING_UI_STAGING_DEPTH       "mahgu.ndi5texture.ui.staging_depth"
+#define OBS_SETTING_UI_ADAPTIVE_STAGING    "mahgu.ndi5texture.ui.adaptive_staging"
+#define OBS_SETTING_UI_STAGING_DEPTH_MIN   "mahgu.ndi5texture.ui.staging_depth_min"
+#define OBS_SETTING_UI_STAGING_DEPTH_MAX   "mahgu.ndi5texture.ui.staging_depth_max"
+#define OBS_SETTING_UI_STALL_THRESHOLD     "mahgu.ndi5texture.ui.stall_threshold"
+#define OBS_SETTING_UI_LOW_LATENCY         "mahgu.ndi5texture.ui.low_latency"
+#define OBS_SETTING_UI_STAGING_STATUS      "mahgu.ndi5texture.ui.staging_status"
+#define OBS_SETTING_UI_MAP_HISTOGRAM       "mahgu.ndi5texture.ui.map_histogram"
+#define OBS_SETTING_UI_LATENCY             "mahgu.ndi5texture.ui.latency"
+#define OBS_SETTING_UI_IDLE_UNWATCHED      "mahgu.ndi5texture.ui.idle_unwatched"
+#define OBS_SETTING_UI_CONNECTIONS         "mahgu.ndi5texture.ui.connections"
+#define OBS_SETTING_UI_TALLY_THROTTLE      "mahgu.ndi5texture.ui.tally_throttle"
+#define OBS_SETTING_UI_TALLY_RATE          "mahgu.ndi5texture.ui.tally_rate"
+#define OBS_SETTING_UI_TALLY_SCALE         "mahgu.ndi5texture.ui.tally_scale"
+#define OBS_SETTING_UI_TALLY_STATUS        "mahgu.ndi5texture.ui.tally_status"
+#define OBS_SETTING_UI_TALLY_PROGRAM       "mahgu.ndi5texture.ui.tally_status.program"
+#define OBS_SETTING_UI_TALLY_PREVIEW       "mahgu.ndi5texture.ui.tally_status.preview"
+#define OBS_SETTING_UI_TALLY_OFF_AIR       "mahgu.ndi5texture.ui.tally_status.off_air"
+#define OBS_SETTING_UI_OUTPUT_SIZE         "mahgu.ndi5texture.ui.output_size"
+#define OBS_SETTING_UI_OUTPUT_SIZE_SOURCE  "mahgu.ndi5texture.ui.output_size.source"
+#define OBS_SETTING_UI_OUTPUT_SIZE_HEIGHT  "mahgu.ndi5texture.ui.output_size.height"
+#define OBS_SETTING_UI_SCALER              "mahgu.ndi5texture.ui.scaler"
+#define OBS_SETTING_UI_SCALER_BILINEAR     "mahgu.ndi5texture.ui.scaler.bilinear"
+#define OBS_SETTING_UI_SCALER_BICUBIC      "mahgu.ndi5texture.ui.scaler.bicubic"
+#define OBS_SETTING_UI_SCALER_LANCZOS      "mahgu.ndi5texture.ui.scaler.lanczos"
+#define OBS_SETTING_UI_SCALER_AREA         "mahgu.ndi5texture.ui.scaler.area"
+#define OBS_SETTING_UI_FRAME_RATE          "mahgu.ndi5texture.ui.frame_rate"
+#define OBS_SETTING_UI_FRAME_RATE_MATCH    "mahgu.ndi5texture.ui.frame_rate.match"
+#define OBS_SETTING_UI_FRAME_RATE_EVERY    "mahgu.ndi5texture.ui.frame_rate.every"
+#define OBS_SETTING_UI_FRAME_RATE_FPS      "mahgu.ndi5texture.ui.frame_rate.fps"
+#define OBS_SETTING_UI_RENDITION           "mahgu.ndi5texture.ui.rendition"
+#define OBS_SETTING_UI_RENDITION_STATUS    "mahgu.ndi5texture.ui.rendition.status"
+#define OBS_SETTING_DEFAULT_RENDITION_NAME "mahgu.ndi5texture.default.rendition_name"
+#define OBS_SETTING_UI_TILES               "mahgu.ndi5texture.ui.tiles"
+#define OBS_SETTING_UI_TILE_LIST           "mahgu.ndi5texture.ui.tile_list"
+#define OBS_SETTING_UI_TILE_STATUS         "mahgu.ndi5texture.ui.tile_status"
+#define OBS_SETTING_DEFAULT_TILE_NAME      "mahgu.ndi5texture.default.tile_name"
+#define OBS_SETTING_UI_CANVAS              "mahgu.ndi5texture.ui.canvas"
+#define OBS_SETTING_UI_CANVAS_WIDTH        "mahgu.ndi5texture.ui.canvas.width"
+#define OBS_SETTING_UI_CANVAS_HEIGHT       "mahgu.ndi5texture.ui.canvas.height"
+#define OBS_SETTING_UI_RESIZE_HOLD         "mahgu.ndi5texture.ui.resize_hold"
+#define OBS_SETTING_UI_RESIZE_STATUS       "mahgu.ndi5texture.ui.resize_status"
+#define OBS_SETTING_UI_FRAME_BUFFER_COUNT  "mahgu.ndi5texture.ui.frame_buffer_count"
+#define OBS_SETTING_UI_MEMORY_USAGE        "mahgu.ndi5texture.ui.memory_usage"
+#define OBS_SETTING_UI_BUFFER_POOL_STATUS  "mahgu.ndi5texture.ui.buffer_pool_status"
+#define OBS_SETTING_UI_BUFFER_POOL_CAP     "mahgu.ndi5texture.ui.buffer_pool_cap"
+#define OBS_SETTING_UI_BUFFER_POOL_NO_CAP  "mahgu.ndi5texture.ui.buffer_pool_cap.none"
+#define OBS_SETTING_UI_BUFFER_STATUS       "mahgu.ndi5texture.ui.buffer_status"
+#define OBS_SETTING_UI_MEMORY_REFRESH      "mahgu.ndi5texture.ui.memory_refresh"
+
+#define OBS_PLUGIN_UYVY_EFFECT             "uyvy-convert.effect"
+#define OBS_PLUGIN_CONFIG_FILE             "config.json"
+
 /* clang-format on */
 
-constexpr int NDI_BUFFER_COUNT = 8; // CURRENTLY NEEDS TO BE MIN 3
-constexpr int NDI_BUFFER_MAX = NDI_BUFFER_COUNT - 1;
+// Upper bound of each pool, the sizes actually used are runtime settings
+constexpr int NDI_BUFFER_COUNT = 8;
+static_assert(NDI_BUFFER_COUNT <= NDI5Filter::Buffers::SET_MAX);
+
+// Frame buffer pool -- the async send holds one until the next send, we fill
+// the other
+constexpr int NDI_FRAME_BUFFER_COUNT_DEFAULT = 2;
+constexpr int NDI_FRAME_BUFFER_COUNT_MIN = 2;
+
+// Frame buffer memory of every filter together, in MB, 0 for no cap
+constexpr int NDI_FRAME_POOL_CAP_DEFAULT_MB = 0;
+constexpr int NDI_FRAME_POOL_CAP_MAX_MB = 65536;
+
+// Staging depth is how many frames pass between staging a surface and mapping
+// it. The ring holds depth surfaces in flight plus one being read back and one
+// spare, so the deepest we can go is NDI_BUFFER_COUNT - 2.
+constexpr int NDI_STAGING_DEPTH_DEFAULT = 1;
+constexpr int NDI_STAGING_DEPTH_MIN = 1;
+constexpr int NDI_STAGING_DEPTH_MAX = NDI_BUFFER_COUNT - 2;
+constexpr int NDI_STAGING_DEPTH_MAX_DEFAULT = 4;
+constexpr int NDI_STAGING_SPARE = 2;
+
+// Adaptive staging -- maps slower than the threshold count as stalls, see
+// ndi5-staging-depth.h
+constexpr int NDI_STALL_THRESHOLD_US_DEFAULT = 1000;
+
+// Low latency mode guesses how long a staged copy takes to land from the maps
+// themselves. Maps that do not wait shave 1/2^NDI_READY_DECAY_SHIFT off the
+// guess, so it keeps probing for a fresher frame.
+constexpr uint32_t NDI_READY_DECAY_SHIFT = 8;
+
+// Frame buffer rows start on a cache line, as do the pool's blocks
+constexpr uint32_t NDI_BUFFER_ALIGNMENT =
+	(uint32_t)NDI5Filter::Buffers::ALIGNMENT;
+
+// Where the NDI texture comes from
+//  AUTO   - capture the filter chain texture, fall back to rendering the
+//           parent when the filter is not being drawn anywhere
+//  FILTER - only capture the filter chain texture
+//  PARENT - always re-render the parent source (original behaviour)
+enum capture_mode : uint32_t {
+	CAPTURE_MODE_AUTO = 0,
+	CAPTURE_MODE_FILTER = 1,
+	CAPTURE_MODE_PARENT = 2,
+};
+
+// What we hand to NDI
+//  RGBA     - raw readback, NDI converts to YUV on the CPU
+//  UYVY_GPU - packed 4:2:2 produced by an effect pass before readback
+//  *_CPU    - RGBA readback converted by our own SIMD kernels
+enum output_format : uint32_t {
+	OUTPUT_FORMAT_RGBA = 0,
+	OUTPUT_FORMAT_UYVY_GPU = 1,
+	OUTPUT_FORMAT_UYVY_CPU = 2,
+	OUTPUT_FORMAT_UYVA_CPU = 3,
+	OUTPUT_FORMAT_BGRX_CPU = 4,
+	OUTPUT_FORMAT_NV12_CPU = 5,
+};
+
+// Output size setting -- 0 sends at the source size, anything else is a
+// height the source is scaled down to (never up), keeping its aspect
+constexpr uint32_t NDI_OUTPUT_SIZE_SOURCE = 0;
+constexpr uint32_t NDI_OUTPUT_HEIGHTS[] = {2160, 1440, 1080, 720, 540, 360};
+
+// Fixed canvas -- the source is fitted into a constant size, so a source that
+// changes size never rebuilds a sender or its buffers
+constexpr int NDI_CANVAS_WIDTH_DEFAULT = 1920;
+constexpr int NDI_CANVAS_HEIGHT_DEFAULT = 1080;
+constexpr int NDI_CANVAS_SIZE_MIN = 16;
+constexpr int NDI_CANVAS_SIZE_MAX = 8192;
+
+// Resize hysteresis -- a new source size has to hold for this many frames
+// before anything is rebuilt for it
+constexpr int NDI_RESIZE_HOLD_DEFAULT = 5;
+constexpr int NDI_RESIZE_HOLD_MAX = 60;
+
+
+// How a scaled output is filtered -- OBS's own scale effects
+enum scaler : uint32_t {
+	SCALER_BILINEAR = 0,
+	SCALER_BICUBIC = 1,
+	SCALER_LANCZOS = 2,
+	SCALER_AREA = 3,
+};
+
+enum color_matrix : uint32_t {
+	COLOR_MATRIX_709 = 0,
+	COLOR_MATRIX_601 = 1,
+};
+
+enum color_range : uint32_t {
+	COLOR_RANGE_PARTIAL = 0,
+	COLOR_RANGE_FULL = 1,
+};
+
+// What the graphics thread does when the send worker has every staging
+// surface in flight
+//  DROP_OLDEST - the worker skips to the newest queued frame
+//  DROP_NEWEST - the frame being captured is not staged
+//  BLOCK       - wait for the worker, up to NDI_BLOCK_TIMEOUT_MS
+enum backpressure : uint32_t {
+	BACKPRESSURE_DROP_OLDEST = 0,
+	BACKPRESSURE_DROP_NEWEST = 1,
+	BACKPRESSURE_BLOCK = 2,
+};
+
+// Never hold up the OBS graphics thread longer than this
+constexpr int NDI_BLOCK_TIMEOUT_MS = 100;
+
+// Receiver monitor -- connections and tally are polled this often, so a new
+// receiver or a tally change is acted on within a frame at 60 fps. It waits
+// on its own condition variable, not inside NDI, so stopping it from the
+// graphics thread never blocks on a poll.
+constexpr uint32_t NDI_MONITOR_POLL_MS = 10;
+
+// Output frame rate setting -- 0 follows OBS, a positive value is a target in
+// frames per second and a negative one sends every -Nth frame
+constexpr int NDI_FRAME_RATE_MATCH = 0;
+constexpr int NDI_FRAME_RATE_EVERY[] = {2, 3, 4};
+constexpr int NDI_FRAME_RATE_TARGETS[] = {60, 50, 30, 25, 24, 15, 10, 5};
+
+// A target within this many parts per thousand of OBS / N is sent as exactly
+// every Nth frame, which keeps 30 on a 59.94 canvas at 30000/1001
+constexpr uint64_t NDI_FRAME_RATE_SNAP_PERMILLE = 5;
+
+// Off air throttling -- divide the frame rate by N, and the width and height
+// by M
+constexpr int NDI_TALLY_RATE_DEFAULT = 4;
+constexpr int NDI_TALLY_RATE_MAX = 8;
+constexpr int NDI_TALLY_SCALE_DEFAULT = 2;
+constexpr int NDI_TALLY_SCALE_MAX = 4;
+
+// Frames off air before the size drops, the rate drops at once
+constexpr uint32_t NDI_TALLY_HOLD = 120;
+
+// Renditions per filter -- the primary sender plus proxies, each with its own
+// output size, all scaled from the same capture
+constexpr uint32_t NDI_RENDITION_COUNT = 3;
+constexpr uint32_t NDI_RENDITION_HEIGHTS_DEFAULT[] = {NDI_OUTPUT_SIZE_SOURCE,
+						      540, 360};
+
+// Video wall -- crop rectangles of the primary, each sent by its own sender
+// straight out of the primary's frame buffers
+constexpr uint32_t NDI_TILE_COUNT = 16;
+
+// Ownership of a staging surface
+enum staging_state : uint32_t {
+	STAGING_FREE = 0,    // ready to be staged into
+	STAGING_PENDING = 1, // staged, waiting for its copy to land
+	STAGING_MAPPED = 2,  // mapped, being read by the worker or NDI
+};
+
+struct config;
+
+// A mapped staging surface, handed to the worker or sent inline
+struct worker_frame {
+	uint32_t slot;
+	uint8_t *data;
+	uint32_t linesize;
+	uint32_t staged_frame; // for latency, frame_count when staged
+	uint64_t staged_ns;
+	int32_t frame_rate_N; // rate when it was mapped
+	int32_t frame_rate_D;
+	int64_t timecode; // OBS video time of the captured frame, 100 ns units
+	std::shared_ptr<const struct config> config; // settings when mapped
+};
+
+// A video wall crop rectangle, in source pixels
+struct tile_rect {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// One video wall tile -- a window into the frame its rendition sends, it has
+// no pixels of its own
+struct tile {
+	tile_rect rect; // what was asked for
+	uint32_t x;     // rect scaled to the rendition's output
+	uint32_t y;
+
+	NDIlib_video_frame_v2_t ndi_video_frame;
+	NDIlib_send_instance_t ndi_sender;
+
+	std::string sender_name;
+};
+
+// A set of tile senders built on tile_thread for Tiles::swap. A kept slot is
+// given the sender of that name the rendition already has.
+struct tile_build {
+	uint32_t count;
+	tile_rect rects[NDI_TILE_COUNT];
+	std::string names[NDI_TILE_COUNT];
+	bool kept[NDI_TILE_COUNT];
+	NDIlib_send_instance_t senders[NDI_TILE_COUNT];
+	std::string base_name;
+};
+
+// Every setting the render path reads, as of one filter_update. Never changed
+// once published -- a new update publishes a new one.
+struct config {
+	uint64_t version; // counts filter_updates
+
+	uint32_t capture_mode;
+	uint32_t output_format;
+	uint32_t scaler;
+	uint32_t color_matrix;
+	uint32_t color_range;
+	NDI5Filter::Kernels::coefficients coefficients;
+
+	bool streaming_readback; // single pass out of staging memory
+	bool zero_copy;          // send straight from mapped memory
+
+	uint32_t frame_buffer_count;
+
+	// Staging ring depth. The fixed depth is also where adapting starts
+	// from.
+	NDI5Filter::Depth::settings staging;
+
+	// Low latency -- map the newest surface whose copy looks done instead
+	// of waiting out the staging depth in frames
+	bool low_latency;
+
+	bool threaded;
+	uint32_t backpressure;
+
+	bool idle_unwatched;
+
+	// Tally throttling -- lower rate and resolution while off air
+	NDI5Filter::Tally::settings tally;
+
+	int32_t frame_rate; // see NDI_FRAME_RATE_MATCH
+
+	// Fixed canvas size, 0 follows the source
+	uint32_t canvas_width;
+	uint32_t canvas_height;
+
+	uint32_t resize_hold;
+
+	// Per rendition, the primary is always enabled
+	bool enabled[NDI_RENDITION_COUNT];
+	uint32_t output_size[NDI_RENDITION_COUNT]; // a height or source size
+	std::string sender_name[NDI_RENDITION_COUNT];
+
+	// Video wall
+	bool tiling;
+	uint32_t tile_rect_count;
+	tile_rect tile_rects[NDI_TILE_COUNT];
+};
 
 #define obs_log(level, format, ...) \
 	blog(level, "[obs-ndi5-filter] " format, ##__VA_ARGS__)
@@ -54,7 +396,7 @@ constexpr int NDI_BUFFER_MAX = NDI_BUFFER_COUNT - 1;
 namespace NDI5Filter {
 
 static const char *filter_get_name(void *unused);
-static obs_properties_t *filter_properties(void *unused);
+static obs_properties_t *filter_properties(void *data);
 
 static void filter_defaults(obs_data_t *defaults);
 static void *filter_create(obs_data_t *settings, obs_source_t *source);
@@ -64,38 +406,262 @@ static void filter_update(void *data, obs_data_t *settings);
 static void filter_video_render(void *data, gs_effect_t *effect);
 static void filter_video_tick(void *data, float seconds);
 
-struct filter {
-	obs_source_t *context;
+namespace Worker {
+static void start(void *data);
+static void stop(void *data);
+static void submit(void *data, const worker_frame &frame);
+} // namespace Worker
+
+namespace Monitor {
+static void start(void *data);
+static void stop(void *data);
+static bool idle(void *data);
+static bool unwatched(void *data);
+} // namespace Monitor
+
+namespace Rename {
+static void request(void *data, const std::string &name);
+static void swap(void *data);
+} // namespace Rename
+
+namespace Tiles {
+static void request(void *data);
+static void swap(void *data);
+} // namespace Tiles
+
+namespace Pacing {
+static bool skip(void *data);
+} // namespace Pacing
+
+namespace Status {
+static void publish(void *data);
+} // namespace Status
+
+struct filter;
+
+// What the properties view shows of a rendition, as of one frame. Published
+// by the graphics thread when any of it changes, never changed after.
+struct rendition_status {
+	bool sender_created;
+	uint32_t staging_depth;
+	uint32_t staging_count;
+	uint32_t width;
+	uint32_t height;
+	int32_t frame_rate_N;
+	int32_t frame_rate_D;
+	uint32_t tile_count;
+	uint64_t texture_bytes; // render targets
+	uint64_t staging_bytes;
 
-	gs_texture_t *prev_target;
-	gs_texture_t *buffer_texture[NDI_BUFFER_COUNT];
-	gs_stagesurf_t *staging_surface[NDI_BUFFER_COUNT];
-	uint8_t *ndi_frame_buffers[NDI_BUFFER_COUNT];
+	bool operator==(const rendition_status &) const = default;
+};
+
+// One NDI output of a filter -- its own sender, size, staging ring and frame
+// buffers, fed from the filter's single capture
+struct rendition {
+	struct filter *filter;
+	uint32_t index; // 0 is the primary, the rest are proxies
+	bool capturing; // takes the frame being captured
 
-	uint8_t *texture_data;
+	gs_texture_t *scaled_texture; // output size, between scale and pack
+	gs_texture_t *render_texture; // drawn into and staged in the same frame
+	gs_stagesurf_t *staging_surface[NDI_BUFFER_COUNT];
+	Buffers::set frame_buffers; // from ndi5_frame_pool
 
 	NDIlib_video_frame_v2_t ndi_video_frame;
-	NDIlib_send_instance_t ndi_sender;
+	std::atomic<NDIlib_send_instance_t> ndi_sender; // polled by the monitor
 
 	bool sender_created;
-	bool frame_allocated;
+
+	// The send thread rebuilds the frame buffers (Framebuffers::refill,
+	// match_linesize), the graphics thread and the properties view read
+	// whether they are allocated and their bytes
+	bool frame_refused; // the shared pool is at its cap, logged once
 	bool first_run_update;
 
+	uint32_t source_width; // the capture these buffers were built for
+	uint32_t source_height;
+	uint32_t width; // what we send, smaller when scaled or throttled
+	uint32_t height;
+	uint32_t depth;
+	std::atomic<uint32_t> size;
+
+	uint32_t frame_width;         // NDI xres (rounded up to even for 4:2:x)
+	uint32_t texture_width;       // ring / staging width in texels
+	std::atomic<uint32_t> stride; // NDI line_stride_in_bytes
+	uint32_t row_bytes;           // bytes of a staging row that hold pixels
+
+	// What the textures and buffers were allocated for, the frame we send
+	// is in their top left corner
+	uint32_t alloc_width; // pixels, a multiple of Resize::BUCKET
+	uint32_t alloc_height;
+	std::atomic<uint32_t> alloc_size; // bytes per frame buffer
+
+	uint32_t allocated_format; // what the buffers were built for
+
+	// Frame buffer pool size actually allocated
+	uint32_t allocated_frame_buffer_count;
+	uint32_t frame_buffer_index; // inline send only
+
+	// Staging ring -- grows and shrinks with the depth
+	Depth::state staging;
+	uint32_t allocated_staging_count;
+	uint32_t staging_state[NDI_BUFFER_COUNT];
+	uint32_t staged_frame[NDI_BUFFER_COUNT]; // frame_count when staged
+	uint64_t staged_ns[NDI_BUFFER_COUNT];
+	uint64_t staged_video_time[NDI_BUFFER_COUNT]; // obs_get_video_frame_time
+	int32_t held_slot; // zero copy surface NDI is reading, inline send only
+
+	uint64_t ready_ns; // low latency, how long a staged copy seems to take
+
+	// Staged to sent, written by whichever thread sends
+	std::atomic<uint64_t> latency_frames;
+	std::atomic<uint64_t> latency_ns;
+	std::atomic<uint64_t> latency_samples;
+	std::atomic<uint32_t> latency_max;
+
+	// Graphics thread time spent on this rendition's readbacks, its scale
+	// and pack passes included
+	std::atomic<uint64_t> readback_ns;
+	std::atomic<uint64_t> readbacks;
+
+	// Send worker -- the graphics thread stages and maps, the worker converts
+	// and sends
+	bool worker_active; // running for the current buffers
+
+	std::thread worker;
+	std::atomic<bool> worker_stop;
+	std::mutex worker_mutex;
+	std::condition_variable worker_wake;
+
+	spsc_queue<worker_frame, NDI_BUFFER_COUNT> work_queue; // to the worker
+	spsc_queue<uint32_t, NDI_BUFFER_COUNT> release_queue;  // back to us
+
+	std::atomic<uint64_t> frames_dropped;
+	std::atomic<uint64_t> frames_unbuffered; // no frame buffer to copy into
+
+	// Receiver monitor -- nothing is captured while nobody is watching
+	bool monitor_active; // running for the current sender
+	bool idling;
+	uint32_t idle_frame; // last frame counted in frames_idle
+
+	// Polls every NDI_MONITOR_POLL_MS, woken early only to stop
+	std::thread monitor;
+	std::mutex monitor_mutex;
+	std::condition_variable monitor_wake;
+	bool monitor_stop; // under monitor_mutex
+
+	std::atomic<int> connections;
+	std::atomic<uint64_t> frames_idle;
+
+	std::atomic<bool> on_program;
+	std::atomic<bool> on_preview;
+
+	// What the tally above means for this frame, updated by
+	// filter_video_tick
+	Tally::state tally;
+
+	// Sender rename -- the new sender is created on rename_thread, away from
+	// the graphics lock, and swapped in by Rename::swap from the next
+	// filter_video_tick. The monitor destroys the sender it replaced.
+	std::thread rename_thread;
+	std::string rename_name;      // latest name asked for
+	std::atomic<bool> rename_busy; // rename_thread still creating it
+
+	std::mutex rename_mutex;
+	NDIlib_send_instance_t renamed_sender; // created, not swapped in yet
+	std::string renamed_name;
+	std::atomic<bool> rename_ready;
+
+	std::atomic<NDIlib_send_instance_t> retired_sender;
+
+	// Video wall tiles cut from this rendition's frames, the primary only.
+	// Sent with every frame the rendition sends, from the same thread.
+	uint32_t tile_count;
+	tile tiles[NDI_TILE_COUNT];
+	std::string tile_base_name; // sender_name the tiles are named after
+	std::atomic<int> tile_connections;
+
+	// Tile senders are created on tile_thread and swapped in whole, like a
+	// rename. The monitor polls the tiles under tile_mutex and destroys
+	// the senders a swap replaced.
+	std::thread tile_thread;
+	std::atomic<bool> tile_busy;  // tile_thread still creating them
+	std::atomic<bool> tile_ready; // tile_built waits for Tiles::swap
+	std::mutex tile_mutex;
+	tile_build tile_built; // under tile_mutex
+	NDIlib_send_instance_t tile_retired[NDI_TILE_COUNT]; // under tile_mutex
+	uint32_t tile_retired_count;                         // under tile_mutex
+
+	// Last set asked for, built or not
+	uint32_t tile_request_count;
+	tile_rect tile_request_rects[NDI_TILE_COUNT];
+	std::string tile_request_name;
+
+	// Output pacing -- which OBS frames get captured at all, and the rate
+	// NDI is told about
+	uint64_t pace_credit;     // Bresenham style accumulator
+	bool frame_due;           // capture this frame
+	int32_t frame_rate_N;     // advertised, reduced
+	int32_t frame_rate_D;
+	uint32_t decimated_frame; // last frame counted in frames_decimated
+	std::atomic<uint64_t> frames_decimated;
+
+	// Status::publish, read by the properties view
+	snapshot<struct rendition_status> status;
+
+	std::string sender_name; // ndi sender name
+};
+
+struct filter {
+	obs_source_t *context;
+
+	gs_texture_t *prev_target;
+	gs_texture_t *captured_texture; // last texture captured via the filter
+	gs_texture_t *capture_texture;  // full size capture when converting
+	gs_effect_t *uyvy_effect;
+
 	enum gs_color_space prev_space;
 	enum gs_color_format texture_format;
 
-	uint32_t width;
-	uint32_t height;
-	uint32_t depth;
-	uint32_t size;
+	uint32_t source_width; // what we capture, the canvas if there is one
+	uint32_t source_height;
+	uint32_t content_width; // the source's own size, drawn into the above
+	uint32_t content_height;
 
-	uint32_t linesize;
-	uint32_t buffer_index;
-	uint32_t frame_count;
+	bool canvas; // what Texture::prepare last applied
 
-	const char *setting_sender_name; // realtime setting
+	std::atomic<uint64_t> capture_bytes; // capture_texture, for the status
 
-	std::string sender_name; // ndi sender name
+	// Resize hysteresis, a size waiting to hold for resize_hold frames
+	uint32_t pending_width;
+	uint32_t pending_height;
+	uint32_t pending_frames;
+	uint32_t pending_frame; // last frame counted in pending_frames
+
+	std::atomic<uint64_t> resizes_rebuilt;    // buffers reallocated
+	std::atomic<uint64_t> resizes_reused;     // sent from the buffers we had
+	std::atomic<uint64_t> resizes_ignored;    // bounced away before holding
+	std::atomic<uint64_t> resize_frames_held; // not captured while waiting
+
+	// Settings -- filter_update publishes a new snapshot and never waits,
+	// the graphics thread takes the latest once per frame in
+	// filter_video_tick. Send workers use the one their frame was mapped
+	// with.
+	snapshot<struct config> published;
+	std::shared_ptr<const struct config> config; // graphics thread only
+	uint64_t config_version;                     // filter_update only
+
+	const Kernels::kernels *kernels;
+
+	std::atomic<uint32_t> frame_count; // read by the send workers as well
+
+	uint32_t captured_frame;        // last frame anything was captured
+	uint32_t filter_captured_frame; // last frame the filter chain was captured
+	uint32_t filter_drawn_frame;    // last frame the filter chain drew us
+
+	// The primary first, everything is captured once for all of them
+	rendition renditions[NDI_RENDITION_COUNT];
 };
 
 struct obs_source_info create_filter_info()
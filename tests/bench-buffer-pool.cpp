@@ -0,0 +1,220 @@
+#include "ndi5-buffer-pool.h"
+#include "test-common.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// The frame buffer pool against what it replaced, at 1080p, 4K and 8K BGRA
+//
+//   rebuild  - a rendition's buffers rebuilt at the same size, from the pool's
+//              spare blocks against fresh from the OS every time
+//   touch    - writing every byte of a block, fresh (every page faulted in)
+//              against one the pool handed back
+//   copy     - a frame copied into a block already faulted in, the pool's
+//              huge pages against 4K pages from the heap
+//
+// ctest runs one iteration so this stays quick and only the copies are
+// checked -- run it by hand with an iteration count for numbers worth
+// comparing:
+//
+//   bench-buffer-pool 50
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+using clock_type = std::chrono::steady_clock;
+
+struct size {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+static const size SIZES[] = {
+	{"1080p", 1920, 1080},
+	{"4k", 3840, 2160},
+	{"8k", 7680, 4320},
+};
+
+static const int BUFFERS = 3;
+
+static size_t frame_bytes(const size &s)
+{
+	return (size_t)s.width * 4 * s.height;
+}
+
+template<typename F> static double seconds(int iterations, F &&f)
+{
+	const auto start = clock_type::now();
+	for (int i = 0; i < iterations; i++)
+		f();
+	return std::chrono::duration<double>(clock_type::now() - start)
+		.count();
+}
+
+static double gbps(size_t bytes, double seconds)
+{
+	return seconds > 0.0 ? bytes / seconds / 1e9 : 0.0;
+}
+
+static uint8_t *heap_alloc(size_t bytes)
+{
+#ifdef _WIN32
+	return static_cast<uint8_t *>(
+		_aligned_malloc(bytes, Buffers::ALIGNMENT));
+#else
+	void *ptr = nullptr;
+	if (posix_memalign(&ptr, Buffers::ALIGNMENT, bytes) != 0)
+		return nullptr;
+	return static_cast<uint8_t *>(ptr);
+#endif
+}
+
+static void heap_free(uint8_t *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static const char *backing_name(Buffers::backing kind)
+{
+	switch (kind) {
+	case Buffers::BACKING_HEAP:
+		return "heap";
+	case Buffers::BACKING_PAGES:
+		return "pages";
+	case Buffers::BACKING_HUGE:
+		return "huge";
+	case Buffers::BACKING_HUGE_ONLY:
+		return "hugetlb";
+	}
+	return "?";
+}
+
+// Buffers::set::create after a destroy, as a rebuild at the same size does
+static void bench_rebuild(const size &s, int iterations)
+{
+	const size_t bytes = frame_bytes(s);
+
+	Buffers::pool p;
+	Buffers::set warm;
+	warm.create(p, BUFFERS, bytes);
+
+	const double pooled = seconds(iterations, [&] {
+		warm.create(p, BUFFERS, bytes);
+	});
+
+	// A pool that keeps nothing spare, every block comes from the OS
+	const double fresh = seconds(iterations, [&] {
+		Buffers::pool empty;
+		Buffers::set cold;
+		cold.create(empty, BUFFERS, bytes);
+		cold.destroy(empty);
+	});
+
+	CHECK(warm.allocated(), "%s: rebuild refused", s.name);
+	warm.destroy(p);
+
+	printf("%-5s rebuild  pool %8.1f us  fresh %8.1f us\n", s.name,
+	       pooled / iterations * 1e6, fresh / iterations * 1e6);
+}
+
+// Writing every byte, the first write to each page faults it in
+static void bench_touch(const size &s, int iterations)
+{
+	const size_t bytes = frame_bytes(s);
+
+	Buffers::pool p;
+	Buffers::block reused = p.acquire(bytes);
+	memset(reused.data, 0, bytes);
+
+	const double warm = seconds(iterations, [&] {
+		memset(reused.data, 0x5a, bytes);
+	});
+
+	const double cold = seconds(iterations, [&] {
+		Buffers::pool empty;
+		Buffers::block b = empty.acquire(bytes);
+		memset(b.data, 0x5a, bytes);
+		empty.release(b);
+	});
+
+	CHECK(reused.data[bytes - 1] == 0x5a, "%s: touch missed", s.name);
+
+	printf("%-5s touch    pool %6.2f GB/s  fresh %6.2f GB/s (%s)\n",
+	       s.name, gbps(bytes * iterations, warm),
+	       gbps(bytes * iterations, cold), backing_name(reused.kind));
+
+	p.release(reused);
+}
+
+// A frame copied into memory already faulted in -- what the send path does
+// every frame, the TLB covers a frame in far fewer huge pages
+static void bench_copy(const size &s, const std::vector<uint8_t> &src,
+		       int iterations)
+{
+	const size_t bytes = frame_bytes(s);
+
+	Buffers::pool p;
+	Buffers::block pooled = p.acquire(bytes);
+	uint8_t *heap = heap_alloc(bytes);
+
+	CHECK(pooled.data && heap, "%s: no memory", s.name);
+	if (!pooled.data || !heap) {
+		p.release(pooled);
+		heap_free(heap);
+		return;
+	}
+
+	memset(pooled.data, 0, bytes);
+	memset(heap, 0, bytes);
+
+	const double to_pool = seconds(iterations, [&] {
+		memcpy(pooled.data, src.data(), bytes);
+	});
+	const double to_heap = seconds(iterations, [&] {
+		memcpy(heap, src.data(), bytes);
+	});
+
+	CHECK(!memcmp(pooled.data, src.data(), bytes) &&
+		      !memcmp(heap, src.data(), bytes),
+	      "%s: copy differs", s.name);
+
+	printf("%-5s copy     pool %6.2f GB/s  heap  %6.2f GB/s (%s)\n",
+	       s.name, gbps(bytes * iterations, to_pool),
+	       gbps(bytes * iterations, to_heap), backing_name(pooled.kind));
+
+	p.release(pooled);
+	heap_free(heap);
+}
+
+int main(int argc, char **argv)
+{
+	const int iterations = argc > 1 ? atoi(argv[1]) : 1;
+	if (iterations < 1) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	printf("%d iterations, %d buffers a rebuild\n", iterations, BUFFERS);
+
+	for (const auto &s : SIZES) {
+		rng r;
+		std::vector<uint8_t> src(frame_bytes(s));
+		r.fill(src.data(), src.size());
+
+		bench_rebuild(s, iterations);
+		bench_touch(s, iterations);
+		bench_copy(s, src, iterations);
+	}
+
+	return result("bench-buffer-pool");
+}
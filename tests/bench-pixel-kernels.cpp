@@ -0,0 +1,176 @@
+#include "ndi5-pixel-kernels.h"
+#include "test-common.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// The fused readback path against the two pass one it replaced, per ISA and
+// output format. Two pass is what Texture::render used to do: memcpy the
+// mapped surface into a frame buffer, then convert that. Fused reads the
+// mapped surface once with convert_frame_streaming. Each runs at 1080p, 4K
+// and 8K.
+//
+// GB/s counts the RGBA bytes read from the surface. ctest runs one
+// iteration so this stays quick and only the outputs are checked -- run it by
+// hand with an iteration count for numbers worth comparing:
+//
+//   bench-pixel-kernels 200
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+using clock_type = std::chrono::steady_clock;
+
+struct size {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+static const size SIZES[] = {
+	{"1080p", 1920, 1080},
+	{"4k", 3840, 2160},
+	{"8k", 7680, 4320},
+};
+
+// Like OBS, the staging pitch is padded past the row
+static uint32_t src_linesize(const size &s)
+{
+	return s.width * 4 + 256;
+}
+
+static const Kernels::format FORMATS[] = {
+	Kernels::FORMAT_UYVY,
+	Kernels::FORMAT_UYVA,
+	Kernels::FORMAT_BGRX,
+	Kernels::FORMAT_NV12,
+};
+
+static const char *format_name(Kernels::format fmt)
+{
+	switch (fmt) {
+	case Kernels::FORMAT_UYVY:
+		return "uyvy";
+	case Kernels::FORMAT_UYVA:
+		return "uyva";
+	case Kernels::FORMAT_BGRX:
+		return "bgrx";
+	case Kernels::FORMAT_NV12:
+		return "nv12";
+	}
+	return "?";
+}
+
+static double gbps(const size &s, clock_type::duration elapsed,
+		   int iterations)
+{
+	const double seconds =
+		std::chrono::duration<double>(elapsed).count();
+	const double bytes = (double)s.width * 4 * s.height * iterations;
+	return seconds > 0.0 ? bytes / seconds / 1e9 : 0.0;
+}
+
+template<typename F> static clock_type::duration time(int iterations, F &&f)
+{
+	f(); // warm up, faults the pages in
+
+	const auto start = clock_type::now();
+	for (int i = 0; i < iterations; i++)
+		f();
+	return clock_type::now() - start;
+}
+
+static void bench(const Kernels::kernels *k, Kernels::format fmt,
+		  const size &s, const std::vector<uint8_t> &src,
+		  int iterations, const Kernels::coefficients &c)
+{
+	const uint32_t linesize = src_linesize(s);
+	const uint32_t stride = Kernels::frame_stride(fmt, s.width);
+	const size_t bytes = Kernels::frame_size(fmt, stride, s.height);
+
+	std::vector<uint8_t> copied((size_t)linesize * s.height);
+	std::vector<uint8_t> two_pass(bytes);
+	std::vector<uint8_t> fused(bytes);
+
+	const auto two_pass_time = time(iterations, [&] {
+		memcpy(copied.data(), src.data(), copied.size());
+		Kernels::convert_frame(k, fmt, copied.data(), linesize,
+				       two_pass.data(), stride, s.width,
+				       s.height, &c);
+	});
+	const auto fused_time = time(iterations, [&] {
+		Kernels::convert_frame_streaming(k, fmt, src.data(), linesize,
+						 fused.data(), stride, s.width,
+						 s.height, &c);
+	});
+
+	CHECK(two_pass == fused, "%s %s %s: fused output differs from two pass",
+	      k->name, format_name(fmt), s.name);
+
+	printf("%-5s %-7s %-5s two pass %6.2f GB/s  fused %6.2f GB/s\n",
+	       s.name, k->name, format_name(fmt),
+	       gbps(s, two_pass_time, iterations),
+	       gbps(s, fused_time, iterations));
+}
+
+// Outputs that need no conversion, one memcpy against the streaming copy
+static void bench_copy(const Kernels::kernels *k, const size &s,
+		       const std::vector<uint8_t> &src, int iterations)
+{
+	const uint32_t linesize = src_linesize(s);
+	const uint32_t row_bytes = s.width * 4;
+
+	std::vector<uint8_t> copied((size_t)row_bytes * s.height);
+	std::vector<uint8_t> streamed((size_t)row_bytes * s.height);
+
+	const auto copy_time = time(iterations, [&] {
+		for (uint32_t y = 0; y < s.height; y++)
+			memcpy(copied.data() + (size_t)y * row_bytes,
+			       src.data() + (size_t)y * linesize, row_bytes);
+	});
+	const auto streamed_time = time(iterations, [&] {
+		Kernels::copy_frame_streaming(k, src.data(), linesize,
+					      streamed.data(), row_bytes,
+					      row_bytes, s.height);
+	});
+
+	CHECK(copied == streamed, "%s rgba %s: streaming copy differs",
+	      k->name, s.name);
+
+	printf("%-5s %-7s %-5s memcpy   %6.2f GB/s  fused %6.2f GB/s\n",
+	       s.name, k->name, "rgba", gbps(s, copy_time, iterations),
+	       gbps(s, streamed_time, iterations));
+}
+
+int main(int argc, char **argv)
+{
+	const int iterations = argc > 1 ? atoi(argv[1]) : 1;
+	if (iterations < 1) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	const auto c = Kernels::make_coefficients(false, false);
+
+	printf("%d iterations\n", iterations);
+
+	for (const auto &s : SIZES) {
+		rng r;
+		std::vector<uint8_t> src((size_t)src_linesize(s) * s.height);
+		r.fill(src.data(), src.size());
+
+		for (uint32_t id = 0; id < Kernels::ISA_COUNT; id++) {
+			const Kernels::kernels *k =
+				Kernels::get((Kernels::isa)id);
+			if (!k)
+				continue;
+
+			for (auto fmt : FORMATS)
+				bench(k, fmt, s, src, iterations, c);
+			bench_copy(k, s, src, iterations);
+		}
+	}
+
+	return result("bench-pixel-kernels");
+}
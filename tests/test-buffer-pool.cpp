@@ -0,0 +1,317 @@
+#include "ndi5-buffer-pool.h"
+#include "test-common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// The frame buffer pool on its own -- every test builds a fresh pool, so the
+// stats start at zero
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+using namespace NDI5Filter::Buffers;
+
+static const size_t MB = 1024 * 1024;
+
+// Frame sizes as the filter asks for them: 720p UYVY, 1080p UYVA, 1080p BGRX
+// and 4K BGRX, either side of HUGE_PAGE_THRESHOLD
+static const size_t FRAME_SIZES[] = {
+	1280 * 720 * 2,
+	1920 * 1080 * 3,
+	1920 * 1080 * 4,
+	3840 * 2160 * 4,
+};
+
+static bool aligned(const block &b, size_t to)
+{
+	return (reinterpret_cast<uintptr_t>(b.data) % to) == 0;
+}
+
+static void test_alignment()
+{
+	static const size_t SIZES[] = {
+		1, 63, 64, 65, 4095, 4097, HUGE_PAGE_THRESHOLD - 1,
+		HUGE_PAGE_THRESHOLD, HUGE_PAGE_THRESHOLD + 1, 33 * MB,
+	};
+	static const size_t COUNT = sizeof(SIZES) / sizeof(SIZES[0]);
+
+	// All held at once, so each is a fresh allocation and not a reuse
+	pool p;
+	block blocks[COUNT];
+
+	for (size_t i = 0; i < COUNT; i++) {
+		const size_t size = SIZES[i];
+		block &b = blocks[i];
+
+		b = p.acquire(size);
+
+		CHECK(b.data, "%zu bytes not allocated", size);
+		if (!b.data)
+			continue;
+
+		CHECK(b.capacity >= size, "%zu bytes got %zu", size,
+		      b.capacity);
+		CHECK(aligned(b, ALIGNMENT), "%zu bytes not on a cache line",
+		      size);
+
+		if (size < HUGE_PAGE_THRESHOLD) {
+			CHECK(b.kind == BACKING_HEAP,
+			      "%zu bytes not on the heap", size);
+		} else {
+			CHECK(b.kind != BACKING_HEAP, "%zu bytes on the heap",
+			      size);
+			CHECK(aligned(b, HUGE_PAGE_SIZE) &&
+				      b.capacity % HUGE_PAGE_SIZE == 0,
+			      "%zu bytes not whole huge pages", size);
+		}
+
+		// Every byte is writable
+		memset(b.data, 0xa5, b.capacity);
+	}
+
+	const stats s = p.get_stats();
+	CHECK(s.allocations == COUNT, "%llu allocations, wanted %zu",
+	      (unsigned long long)s.allocations, COUNT);
+	CHECK(s.huge_bytes <= s.bytes, "%llu huge bytes of %llu",
+	      (unsigned long long)s.huge_bytes, (unsigned long long)s.bytes);
+
+	for (auto &b : blocks) {
+		p.release(b);
+		CHECK(!b.data && !b.capacity, "release left the block set");
+	}
+}
+
+static void test_reuse()
+{
+	pool p;
+
+	block first = p.acquire(FRAME_SIZES[2]);
+	uint8_t *data = first.data;
+	p.release(first);
+
+	// The same size, and a little smaller, get the same block back
+	block again = p.acquire(FRAME_SIZES[2]);
+	CHECK(again.data == data, "same size not reused");
+	p.release(again);
+
+	block smaller = p.acquire(FRAME_SIZES[1]);
+	CHECK(smaller.data == data, "smaller size not reused");
+	p.release(smaller);
+
+	// Far smaller would waste most of the block, larger won't fit
+	block tiny = p.acquire(FRAME_SIZES[2] / REUSE_SLACK / 2);
+	CHECK(tiny.data != data, "block reused for 1/%zu of its size",
+	      REUSE_SLACK * 2);
+
+	block larger = p.acquire(FRAME_SIZES[3]);
+	CHECK(larger.data != data && larger.capacity >= FRAME_SIZES[3],
+	      "block reused for a larger size");
+
+	p.release(tiny);
+	p.release(larger);
+
+	const stats s = p.get_stats();
+	CHECK(s.allocations == 3 && s.reuses == 2,
+	      "%llu allocations, %llu reuses",
+	      (unsigned long long)s.allocations, (unsigned long long)s.reuses);
+
+	// The smallest block that fits is picked over a bigger one
+	block big = p.acquire(FRAME_SIZES[2]);
+	block small = p.acquire(FRAME_SIZES[1]);
+	uint8_t *small_data = small.data;
+	p.release(big);
+	p.release(small);
+
+	block fit = p.acquire(FRAME_SIZES[1]);
+	CHECK(fit.data == small_data, "best fit not picked");
+	p.release(fit);
+}
+
+// A rendition rebuilding its frame buffers over and over -- at a resolution
+// change, a format change, a sender rename -- allocates only the first time
+static void test_steady_state()
+{
+	static const int BUFFERS = 3;
+
+	for (size_t size : FRAME_SIZES) {
+		pool p;
+		block frames[BUFFERS];
+
+		for (auto &frame : frames)
+			frame = p.acquire(size);
+		for (auto &frame : frames)
+			p.release(frame);
+
+		const stats before = p.get_stats();
+
+		for (int cycle = 0; cycle < 100; cycle++) {
+			for (auto &frame : frames)
+				frame = p.acquire(size);
+			for (auto &frame : frames)
+				p.release(frame);
+		}
+
+		const stats after = p.get_stats();
+
+		CHECK(after.allocations == before.allocations &&
+			      after.frees == before.frees,
+		      "%zu bytes: %llu allocations, %llu frees steady state",
+		      size,
+		      (unsigned long long)(after.allocations -
+					   before.allocations),
+		      (unsigned long long)(after.frees - before.frees));
+		CHECK(after.reuses == before.reuses + 100 * BUFFERS,
+		      "%zu bytes: %llu reuses, wanted %d", size,
+		      (unsigned long long)(after.reuses - before.reuses),
+		      100 * BUFFERS);
+		CHECK(after.bytes == before.bytes,
+		      "%zu bytes: held bytes moved", size);
+	}
+}
+
+// Past the cap released blocks go first, then requests are refused and the
+// pool reports pressure until one succeeds again
+static void test_cap()
+{
+	const size_t size = FRAME_SIZES[3];
+
+	pool p;
+	block a = p.acquire(size);
+	const uint64_t capacity = a.capacity;
+
+	p.set_cap(capacity * 2);
+
+	block b = p.acquire(size);
+	block c = p.acquire(size);
+
+	CHECK(b.data && !c.data, "cap of two blocks not held");
+	CHECK(p.pressure(), "no pressure after a refusal");
+
+	stats s = p.get_stats();
+	CHECK(s.refusals == 1 && s.bytes == capacity * 2 &&
+		      s.cap == capacity * 2,
+	      "%llu refusals, %llu bytes under a %llu cap",
+	      (unsigned long long)s.refusals, (unsigned long long)s.bytes,
+	      (unsigned long long)s.cap);
+
+	// A spare block is freed to make room for a request of another size
+	p.release(b);
+	block other = p.acquire(FRAME_SIZES[0] * 2 / 3);
+
+	CHECK(other.data && !p.pressure(), "spare not freed for a request");
+	s = p.get_stats();
+	CHECK(s.frees == 1 && s.bytes == capacity + other.capacity,
+	      "%llu frees, %llu bytes after making room",
+	      (unsigned long long)s.frees, (unsigned long long)s.bytes);
+	p.release(other);
+
+	// Lowering the cap frees spares at once and blocks still out as they
+	// come back
+	p.set_cap(capacity / 2);
+	s = p.get_stats();
+	CHECK(s.bytes == capacity, "%llu bytes, only the block out should stay",
+	      (unsigned long long)s.bytes);
+
+	p.release(a);
+	s = p.get_stats();
+	CHECK(s.bytes == 0, "%llu bytes kept over the cap",
+	      (unsigned long long)s.bytes);
+
+	// No cap, no refusals
+	p.set_cap(0);
+	block d = p.acquire(size);
+	block e = p.acquire(size);
+	CHECK(d.data && e.data && !p.pressure(), "refused with no cap");
+	p.release(d);
+	p.release(e);
+}
+
+// The free list holds at most FREE_BLOCKS blocks and FREE_BYTES bytes however
+// much is released, a block larger than FREE_BYTES is freed outright
+static void test_free_list_bounds()
+{
+	{
+		pool p;
+		block blocks[FREE_BLOCKS + 4];
+
+		for (auto &b : blocks)
+			b = p.acquire(4096);
+		for (auto &b : blocks)
+			p.release(b);
+
+		const stats s = p.get_stats();
+		CHECK(s.frees == 4 && s.bytes == FREE_BLOCKS * 4096,
+		      "%llu frees, %llu bytes kept of %d small blocks",
+		      (unsigned long long)s.frees, (unsigned long long)s.bytes,
+		      FREE_BLOCKS + 4);
+	}
+
+	{
+		// 16 blocks of 34 MB would keep 544 MB spare
+		pool p;
+		block blocks[FREE_BLOCKS];
+
+		for (auto &b : blocks)
+			b = p.acquire(33 * MB);
+		for (auto &b : blocks)
+			p.release(b);
+
+		const stats s = p.get_stats();
+		CHECK(s.bytes <= FREE_BYTES && s.bytes + 34 * MB > FREE_BYTES,
+		      "%llu bytes kept spare, bound %zu",
+		      (unsigned long long)s.bytes, FREE_BYTES);
+	}
+
+	{
+		pool p;
+		block huge = p.acquire(FREE_BYTES + 1);
+
+		CHECK(huge.data, "block past FREE_BYTES not allocated");
+		p.release(huge);
+
+		const stats s = p.get_stats();
+		CHECK(s.bytes == 0 && s.frees == 1,
+		      "%llu bytes kept of a block past FREE_BYTES",
+		      (unsigned long long)s.bytes);
+	}
+}
+
+// What filter_destroy leaves behind: nothing spare, blocks out are untouched
+static void test_trim()
+{
+	pool p;
+	block out = p.acquire(FRAME_SIZES[2]);
+	block spare[3];
+
+	for (size_t i = 0; i < 3; i++)
+		spare[i] = p.acquire(FRAME_SIZES[i]);
+	for (auto &b : spare)
+		p.release(b);
+
+	p.trim();
+
+	stats s = p.get_stats();
+	CHECK(s.bytes == out.capacity && s.frees == 3,
+	      "%llu bytes, %llu frees after trim", (unsigned long long)s.bytes,
+	      (unsigned long long)s.frees);
+
+	p.release(out);
+	p.trim();
+
+	s = p.get_stats();
+	CHECK(s.bytes == 0 && s.huge_bytes == 0,
+	      "%llu bytes, %llu huge bytes after the last trim",
+	      (unsigned long long)s.bytes, (unsigned long long)s.huge_bytes);
+}
+
+int main()
+{
+	test_alignment();
+	test_reuse();
+	test_steady_state();
+	test_cap();
+	test_free_list_bounds();
+	test_trim();
+
+	return result("test-buffer-pool");
+}
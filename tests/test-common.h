@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Just enough for the tests here, no framework. A failed CHECK is printed and
+// counted, main returns the count so ctest sees it.
+
+namespace NDI5Filter::Tests {
+
+inline int failures = 0;
+
+// xorshift32 -- the same bytes on every run and every compiler
+struct rng {
+	uint32_t state = 0x9e3779b9;
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	void fill(uint8_t *p, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; i++)
+			p[i] = (uint8_t)next();
+	}
+};
+
+inline int result(const char *name)
+{
+	printf("%s: %s (%d failures)\n", name, failures ? "FAILED" : "passed",
+	       failures);
+	return failures ? 1 : 0;
+}
+
+} // namespace NDI5Filter::Tests
+
+#define CHECK(cond, ...)                                            \
+	do {                                                        \
+		if (!(cond)) {                                      \
+			NDI5Filter::Tests::failures++;              \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);               \
+			fputc('\n', stderr);                        \
+		}                                                   \
+	} while (0)
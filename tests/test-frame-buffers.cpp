@@ -0,0 +1,247 @@
+#include "ndi5-buffer-pool.h"
+#include "ndi5-pixel-kernels.h"
+#include "ndi5-resize.h"
+#include "test-common.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+// Frame buffers through the filter's own lifecycle -- built for a size, the
+// staging pitch adopted on the first map, source resizes, buffer count
+// changes, and given back while idle. Once through every size, and once more
+// for the spare blocks to settle on which size each one serves, the same
+// again allocates nothing, from the pool or the heap. The spare blocks
+// of a 4K primary with up to 4 buffers, its 1080p ones and a 720p proxy stay
+// within Buffers::FREE_BYTES -- past that a 4K rebuild allocates again, as
+// the pool says.
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+// Every heap allocation anything in the process makes
+static std::atomic<uint64_t> heap_allocations{0};
+
+void *operator new(size_t size)
+{
+	heap_allocations++;
+
+	if (void *p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+// What Texture::layout works out for a rendition, and what the buffers are
+// rebuilt at once Framebuffers::match_linesize adopts the staging pitch
+struct rendition {
+	bool convert;        // CPU kernel, else a straight copy
+	Kernels::format fmt; // when converting
+	uint32_t output_height; // 0 for the source's size
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t alloc_width;
+	uint32_t alloc_height;
+	size_t alloc_size;
+	uint32_t buffer_count;
+
+	Buffers::set buffers;
+};
+
+static uint32_t align_stride(uint32_t stride)
+{
+	return (stride + Buffers::ALIGNMENT - 1) & ~(Buffers::ALIGNMENT - 1);
+}
+
+// OBS pads staging rows past the texture's
+static uint32_t staging_linesize(const rendition &r)
+{
+	return r.alloc_width * 4 + 256;
+}
+
+static bool build(Buffers::pool &p, rendition &r)
+{
+	return r.buffers.create(p, r.buffer_count, r.alloc_size);
+}
+
+// Texture::prepare for a new source size -- laid out again in the buffers it
+// has when they fit, rebuilt at the next buckets otherwise
+static bool resize(Buffers::pool &p, rendition &r, uint32_t cx, uint32_t cy)
+{
+	r.width = cx;
+	r.height = cy;
+
+	if (r.output_height && r.output_height < cy) {
+		r.height = r.output_height;
+		r.width = (uint32_t)(((uint64_t)cx * r.height + cy / 2) / cy) &
+			  ~1u;
+	}
+
+	if (r.buffers.allocated() &&
+	    Resize::reusable(r.alloc_width, r.alloc_height, r.width, r.height))
+		return true;
+
+	r.alloc_width = Resize::bucket(r.width);
+	r.alloc_height = Resize::bucket(r.height);
+
+	if (r.convert) {
+		const uint32_t stride = align_stride(
+			Kernels::frame_stride(r.fmt, r.alloc_width));
+		r.alloc_size =
+			Kernels::frame_size(r.fmt, stride, r.alloc_height);
+	} else {
+		// Guessed, corrected on the first map
+		r.alloc_size = (size_t)align_stride(r.alloc_width * 4) *
+			       r.alloc_height;
+	}
+
+	if (!build(p, r))
+		return false;
+
+	// Only a copy sends straight from the staging pitch
+	if (r.convert)
+		return true;
+
+	r.alloc_size = (size_t)staging_linesize(r) * r.alloc_height;
+	r.buffers.destroy(p);
+	return build(p, r);
+}
+
+// The sizes a source goes through, from nearby ones that only lay out again
+// to 4K and back
+static const uint32_t SOURCES[][2] = {
+	{1920, 1080}, {1910, 1076}, {1280, 720}, {1920, 1080},
+	{3840, 2160}, {3800, 2140}, {1920, 1080},
+};
+
+// One pass of everything the filter does to its frame buffers, a primary
+// sent as a straight copy and a 720p UYVY proxy sharing the pool. True if
+// nothing was refused.
+static bool pass(Buffers::pool &p, rendition &primary, rendition &proxy)
+{
+	bool built = true;
+
+	for (const auto &source : SOURCES) {
+		for (auto r : {&primary, &proxy})
+			built = resize(p, *r, source[0], source[1]) && built;
+
+		// Texture::resize_pools -- a buffer more and back, a rebuild at
+		// the same size
+		primary.buffer_count = 4;
+		primary.buffers.destroy(p);
+		built = build(p, primary) && built;
+
+		primary.buffer_count = 3;
+		primary.buffers.destroy(p);
+		built = build(p, primary) && built;
+
+		// Framebuffers::evict and refill -- unwatched under pressure,
+		// then a receiver turns up
+		proxy.buffers.destroy(p);
+		built = build(p, proxy) && built;
+	}
+
+	return built;
+}
+
+static void test_steady_state()
+{
+	Buffers::pool p;
+
+	rendition primary = {};
+	primary.buffer_count = 3;
+
+	rendition proxy = {};
+	proxy.convert = true;
+	proxy.fmt = Kernels::FORMAT_UYVY;
+	proxy.output_height = 720;
+	proxy.buffer_count = 3;
+
+	for (int i = 0; i < 2; i++)
+		CHECK(pass(p, primary, proxy), "buffers refused with no cap");
+
+	const Buffers::stats before = p.get_stats();
+	const uint64_t heap_before = heap_allocations;
+
+	bool built = true;
+	for (int i = 0; i < 50; i++)
+		built = pass(p, primary, proxy) && built;
+
+	const Buffers::stats after = p.get_stats();
+	const uint64_t heap = heap_allocations - heap_before;
+
+	CHECK(built, "buffers refused in the steady state");
+	CHECK(after.allocations == before.allocations &&
+		      after.frees == before.frees,
+	      "%llu pool allocations, %llu frees in the steady state",
+	      (unsigned long long)(after.allocations - before.allocations),
+	      (unsigned long long)(after.frees - before.frees));
+	CHECK(after.reuses > before.reuses, "nothing reused");
+	CHECK(!heap, "%llu heap allocations in the steady state",
+	      (unsigned long long)heap);
+
+	printf("%llu allocations settling, 50 passes %llu reuses, %.1f MB held\n",
+	       (unsigned long long)before.allocations,
+	       (unsigned long long)(after.reuses - before.reuses),
+	       after.bytes / 1048576.0);
+
+	primary.buffers.destroy(p);
+	proxy.buffers.destroy(p);
+}
+
+// All or nothing, and whatever it held before goes back first
+static void test_set()
+{
+	const size_t size = 1920 * 1088 * 4;
+
+	Buffers::pool p;
+	Buffers::set s;
+
+	CHECK(s.create(p, 3, size) && s.allocated(), "not created");
+	CHECK(s.bytes() >= 3 * size, "%llu bytes for 3 of %zu",
+	      (unsigned long long)s.bytes(), size);
+
+	for (uint32_t i = 0; i < 3; i++)
+		CHECK(s.data(i), "block %u missing", i);
+
+	// Created again at a smaller size, in the same blocks
+	uint8_t *first = s.data(0);
+	CHECK(s.create(p, 2, size / 2) && s.data(0) == first && !s.data(2),
+	      "held blocks not handed back first");
+	CHECK(p.get_stats().allocations == 3, "rebuilt with %llu allocations",
+	      (unsigned long long)p.get_stats().allocations);
+
+	// Room for two, a third is refused and nothing is kept
+	s.destroy(p);
+	p.trim();
+	p.set_cap(Buffers::HUGE_PAGE_SIZE * 2 * 4 + 1);
+
+	Buffers::set refused;
+	CHECK(!refused.create(p, 3, size), "created past the cap");
+	CHECK(!refused.allocated() && !refused.bytes() && !refused.data(0),
+	      "refused set kept blocks");
+	CHECK(p.pressure(), "no pressure after a refusal");
+
+	CHECK(refused.create(p, 2, size), "two not created under the cap");
+	refused.destroy(p);
+	CHECK(!refused.allocated() && p.get_stats().bytes,
+	      "destroy did not hand blocks back to the pool");
+}
+
+int main()
+{
+	test_set();
+	test_steady_state();
+
+	return result("test-frame-buffers");
+}
@@ -0,0 +1,426 @@
+#include "ndi5-pixel-kernels.h"
+#include "test-common.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+// Every kernel set this CPU can run against the scalar reference, bit for bit,
+// at widths that land on and either side of every vector and block width
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+// Bytes written past the end of an output are caught by these
+constexpr size_t GUARD = 64;
+constexpr uint8_t GUARD_BYTE = 0xcd;
+
+static const uint32_t WIDTHS[] = {
+	1,   2,   3,   4,   5,   6,   7,   8,    9,    15,   16,   17,
+	23,  24,  25,  31,  32,  33,  47,  48,   49,   63,   64,   65,
+	67,  127, 128, 129, 130, 255, 256, 257,  258,  1279, 1280, 1281,
+	2047, 2048, 2049, 2050, 4097,
+};
+
+static const uint32_t HEIGHTS[] = {1, 2, 3, 4, 17};
+
+static const Kernels::format FORMATS[] = {
+	Kernels::FORMAT_UYVY,
+	Kernels::FORMAT_UYVA,
+	Kernels::FORMAT_BGRX,
+	Kernels::FORMAT_NV12,
+};
+
+static const char *format_name(Kernels::format fmt)
+{
+	switch (fmt) {
+	case Kernels::FORMAT_UYVY:
+		return "uyvy";
+	case Kernels::FORMAT_UYVA:
+		return "uyva";
+	case Kernels::FORMAT_BGRX:
+		return "bgrx";
+	case Kernels::FORMAT_NV12:
+		return "nv12";
+	}
+	return "?";
+}
+
+// Random pixels with runs of black and white mixed in, so clamping is hit
+static std::vector<uint8_t> make_pixels(rng &r, size_t bytes)
+{
+	std::vector<uint8_t> pixels(bytes);
+	r.fill(pixels.data(), bytes);
+
+	for (size_t i = 0; i + 4 <= bytes; i += 4) {
+		const uint32_t pick = r.next() & 15;
+
+		if (pick == 0)
+			memset(&pixels[i], 0, 4);
+		else if (pick == 1)
+			memset(&pixels[i], 255, 4);
+	}
+
+	return pixels;
+}
+
+static bool guard_intact(const std::vector<uint8_t> &out, size_t used)
+{
+	for (size_t i = used; i < out.size(); i++)
+		if (out[i] != GUARD_BYTE)
+			return false;
+	return true;
+}
+
+// Index of the first byte that differs, -1 if none
+static long first_difference(const std::vector<uint8_t> &a,
+			     const std::vector<uint8_t> &b)
+{
+	for (size_t i = 0; i < a.size() && i < b.size(); i++)
+		if (a[i] != b[i])
+			return (long)i;
+	return a.size() == b.size() ? -1 : (long)std::min(a.size(), b.size());
+}
+
+static void test_reference_values()
+{
+	auto k = Kernels::get(Kernels::ISA_SCALAR);
+
+	const uint8_t black_white[8] = {0, 0, 0, 255, 255, 255, 255, 255};
+	uint8_t out[4];
+
+	auto limited = Kernels::make_coefficients(false, false);
+	k->uyvy_row(black_white, out, 2, &limited);
+
+	CHECK(out[1] == 16 && out[3] == 235,
+	      "709 limited: black %u white %u, want 16 235", out[1], out[3]);
+	CHECK(out[0] == 128 && out[2] == 128,
+	      "709 limited: grey chroma %u %u, want 128", out[0], out[2]);
+
+	auto full = Kernels::make_coefficients(true, true);
+	k->uyvy_row(black_white, out, 2, &full);
+
+	CHECK(out[1] == 0 && out[3] == 255,
+	      "601 full: black %u white %u, want 0 255", out[1], out[3]);
+
+	// Pure red has the largest Cr there is
+	const uint8_t red[4] = {255, 0, 0, 255};
+	k->uyvy_row(red, out, 1, &limited);
+
+	CHECK(out[2] == 240, "709 limited: red Cr %u, want 240", out[2]);
+	CHECK(out[1] == out[3], "odd width: last Y %u %u", out[1], out[3]);
+}
+
+static void test_rows(const Kernels::kernels *k,
+		      const Kernels::coefficients &c, rng &r)
+{
+	auto ref = Kernels::get(Kernels::ISA_SCALAR);
+
+	for (uint32_t width : WIDTHS) {
+		auto row0 = make_pixels(r, (size_t)width * 4);
+		auto row1 = make_pixels(r, (size_t)width * 4);
+
+		const size_t pairs = (width + 1) / 2;
+
+		auto run = [&](const char *name, size_t used, auto &&fn) {
+			std::vector<uint8_t> want(used + GUARD, GUARD_BYTE);
+			std::vector<uint8_t> got(used + GUARD, GUARD_BYTE);
+
+			fn(ref, want.data());
+			fn(k, got.data());
+
+			const long at = first_difference(want, got);
+
+			CHECK(at < 0, "%s %s width %u: byte %ld is %u, want %u",
+			      k->name, name, width, at, at < 0 ? 0 : got[at],
+			      at < 0 ? 0 : want[at]);
+			CHECK(guard_intact(got, used),
+			      "%s %s width %u: wrote past %zu bytes", k->name,
+			      name, width, used);
+		};
+
+		run("uyvy_row", pairs * 4,
+		    [&](const Kernels::kernels *kk, uint8_t *dst) {
+			    kk->uyvy_row(row0.data(), dst, width, &c);
+		    });
+		run("y_row", width,
+		    [&](const Kernels::kernels *kk, uint8_t *dst) {
+			    kk->y_row(row0.data(), dst, width, &c);
+		    });
+		run("uv_row", pairs * 2,
+		    [&](const Kernels::kernels *kk, uint8_t *dst) {
+			    kk->uv_row(row0.data(), row1.data(), dst, width,
+				       &c);
+		    });
+		run("alpha_row", width,
+		    [&](const Kernels::kernels *kk, uint8_t *dst) {
+			    kk->alpha_row(row0.data(), dst, width);
+		    });
+		run("bgrx_row", (size_t)width * 4,
+		    [&](const Kernels::kernels *kk, uint8_t *dst) {
+			    kk->bgrx_row(row0.data(), dst, width);
+		    });
+	}
+}
+
+static void test_stream(const Kernels::kernels *k, const char *name,
+			Kernels::stream_fn fn, size_t bytes, size_t src_at,
+			size_t dst_at, rng &r)
+{
+	std::vector<uint8_t> src(src_at + bytes);
+	std::vector<uint8_t> dst(dst_at + bytes + GUARD, GUARD_BYTE);
+
+	r.fill(src.data(), src.size());
+
+	fn(src.data() + src_at, dst.data() + dst_at, bytes);
+	k->stream_fence();
+
+	CHECK(!memcmp(src.data() + src_at, dst.data() + dst_at, bytes),
+	      "%s %s: %zu bytes from +%zu to +%zu differ", k->name, name,
+	      bytes, src_at, dst_at);
+
+	bool intact = guard_intact(dst, dst_at + bytes);
+
+	for (size_t i = 0; i < dst_at; i++)
+		intact = intact && dst[i] == GUARD_BYTE;
+
+	CHECK(intact, "%s %s: %zu bytes to +%zu wrote outside", k->name,
+	      name, bytes, dst_at);
+}
+
+// Byte copies at every alignment of either end, vector allocations are at
+// least 16 byte aligned
+static void test_streams(const Kernels::kernels *k, rng &r)
+{
+	static const size_t LENGTHS[] = {0,  1,  15,  16,  17,  63,   64,
+					 65, 79, 127, 128, 129, 4095, 8193};
+
+	for (size_t bytes : LENGTHS) {
+		for (size_t src_at = 0; src_at < 16; src_at += 3) {
+			for (size_t dst_at = 0; dst_at < 16; dst_at += 5) {
+				test_stream(k, "stream_load", k->stream_load,
+					    bytes, src_at, dst_at, r);
+				test_stream(k, "stream_store", k->stream_store,
+					    bytes, src_at, dst_at, r);
+				test_stream(k, "stream_copy", k->stream_copy,
+					    bytes, src_at, dst_at, r);
+			}
+		}
+	}
+}
+
+// Both frame paths against the scalar convert_frame, tightly packed
+static void test_frames(const Kernels::kernels *k,
+			const Kernels::coefficients &c, rng &r)
+{
+	auto ref = Kernels::get(Kernels::ISA_SCALAR);
+
+	for (auto fmt : FORMATS) {
+		for (uint32_t width : WIDTHS) {
+			for (uint32_t height : HEIGHTS) {
+				const uint32_t src_linesize = width * 4;
+				const uint32_t stride =
+					Kernels::frame_stride(fmt, width);
+				const size_t used = Kernels::frame_size(
+					fmt, stride, height);
+
+				auto src = make_pixels(
+					r, (size_t)src_linesize * height);
+
+				std::vector<uint8_t> want(used + GUARD,
+							  GUARD_BYTE);
+				std::vector<uint8_t> got(used + GUARD,
+							 GUARD_BYTE);
+				std::vector<uint8_t> streamed(used + GUARD,
+							      GUARD_BYTE);
+
+				Kernels::convert_frame(ref, fmt, src.data(),
+						       src_linesize,
+						       want.data(), stride,
+						       width, height, &c);
+				Kernels::convert_frame(k, fmt, src.data(),
+						       src_linesize, got.data(),
+						       stride, width, height,
+						       &c);
+				Kernels::convert_frame_streaming(
+					k, fmt, src.data(), src_linesize,
+					streamed.data(), stride, width, height,
+					&c);
+
+				const long at = first_difference(want, got);
+				const long streamed_at =
+					first_difference(want, streamed);
+
+				CHECK(at < 0,
+				      "%s %s %ux%u: convert_frame byte %ld differs",
+				      k->name, format_name(fmt), width, height,
+				      at);
+				CHECK(streamed_at < 0,
+				      "%s %s %ux%u: streaming byte %ld differs",
+				      k->name, format_name(fmt), width, height,
+				      streamed_at);
+			}
+		}
+	}
+
+	// Outputs that need no conversion are copied row by row
+	for (uint32_t width : WIDTHS) {
+		const uint32_t row_bytes = width * 4;
+		const uint32_t height = 3;
+
+		auto src = make_pixels(r, (size_t)row_bytes * height);
+		std::vector<uint8_t> got((size_t)row_bytes * height + GUARD,
+					 GUARD_BYTE);
+
+		Kernels::copy_frame_streaming(k, src.data(), row_bytes,
+					      got.data(), row_bytes, row_bytes,
+					      height);
+
+		CHECK(!memcmp(src.data(), got.data(), src.size()) &&
+			      guard_intact(got, src.size()),
+		      "%s copy_frame_streaming width %u", k->name, width);
+	}
+}
+
+static uint32_t align_up(uint32_t value, uint32_t to)
+{
+	return (value + to - 1) / to * to;
+}
+
+// Bytes from row_bytes to stride of every row still hold GUARD_BYTE
+static bool padding_intact(const std::vector<uint8_t> &out, uint32_t stride,
+			   uint32_t row_bytes, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++)
+		for (uint32_t x = row_bytes; x < stride; x++)
+			if (out[(size_t)y * stride + x] != GUARD_BYTE)
+				return false;
+	return true;
+}
+
+static void test_padded_frame(const Kernels::kernels *k, Kernels::format fmt,
+			      uint32_t width, uint32_t height,
+			      const Kernels::coefficients &c, rng &r)
+{
+	auto ref = Kernels::get(Kernels::ISA_SCALAR);
+
+	const uint32_t src_linesize = align_up(width * 4, 256) + 64;
+	const uint32_t row_bytes = Kernels::frame_stride(fmt, width);
+	const uint32_t stride = align_up(row_bytes, 64) + 64;
+	const size_t used = Kernels::frame_size(fmt, stride, height);
+
+	// Padding differs between the two sources, the outputs may not
+	auto src = make_pixels(r, (size_t)src_linesize * height);
+	auto noisy = src;
+
+	for (uint32_t y = 0; y < height; y++)
+		r.fill(noisy.data() + (size_t)y * src_linesize + width * 4,
+		       src_linesize - width * 4);
+
+	std::vector<uint8_t> want(used + GUARD, GUARD_BYTE);
+	std::vector<uint8_t> got(used + GUARD, GUARD_BYTE);
+	std::vector<uint8_t> streamed(used + GUARD, GUARD_BYTE);
+
+	Kernels::convert_frame(ref, fmt, src.data(), src_linesize, want.data(),
+			       stride, width, height, &c);
+	Kernels::convert_frame(k, fmt, noisy.data(), src_linesize, got.data(),
+			       stride, width, height, &c);
+	Kernels::convert_frame_streaming(k, fmt, noisy.data(), src_linesize,
+					 streamed.data(), stride, width, height,
+					 &c);
+
+	const long at = first_difference(want, got);
+	const long streamed_at = first_difference(want, streamed);
+
+	CHECK(at < 0, "%s %s %ux%u padded: convert_frame byte %ld differs",
+	      k->name, format_name(fmt), width, height, at);
+	CHECK(streamed_at < 0, "%s %s %ux%u padded: streaming byte %ld differs",
+	      k->name, format_name(fmt), width, height, streamed_at);
+
+	// The first plane's padding is left alone
+	CHECK(padding_intact(want, stride, row_bytes, height),
+	      "%s %ux%u padded: row padding written", format_name(fmt), width,
+	      height);
+}
+
+// Rows as OBS maps them (a pitch past the row, padding full of whatever was
+// there) and as the frame buffers are laid out (a 64 byte aligned stride).
+// Nothing may be read from or written to the padding.
+static void test_padded_frames(const Kernels::kernels *k,
+			       const Kernels::coefficients &c, rng &r)
+{
+	static const uint32_t PADDED_HEIGHTS[] = {1, 3, 17};
+
+	for (auto fmt : FORMATS)
+		for (uint32_t width : WIDTHS)
+			for (uint32_t height : PADDED_HEIGHTS)
+				test_padded_frame(k, fmt, width, height, c, r);
+
+	// Row copies between two different pitches
+	for (uint32_t width : WIDTHS) {
+		const uint32_t row_bytes = width * 4;
+		const uint32_t src_linesize = align_up(row_bytes, 256) + 64;
+		const uint32_t stride = align_up(row_bytes, 64) + 64;
+		const uint32_t height = 3;
+
+		auto src = make_pixels(r, (size_t)src_linesize * height);
+		std::vector<uint8_t> got((size_t)stride * height + GUARD,
+					 GUARD_BYTE);
+
+		Kernels::copy_frame_streaming(k, src.data(), src_linesize,
+					      got.data(), stride, row_bytes,
+					      height);
+
+		bool same = guard_intact(got, (size_t)stride * height) &&
+			    padding_intact(got, stride, row_bytes, height);
+
+		for (uint32_t y = 0; y < height; y++)
+			same = same &&
+			       !memcmp(src.data() + (size_t)y * src_linesize,
+				       got.data() + (size_t)y * stride,
+				       row_bytes);
+
+		CHECK(same, "%s copy_frame_streaming width %u padded", k->name,
+		      width);
+	}
+}
+
+int main()
+{
+	test_reference_values();
+
+	const struct {
+		bool bt601;
+		bool full_range;
+	} matrices[] = {{false, false}, {false, true}, {true, false},
+			{true, true}};
+
+	for (uint32_t id = Kernels::ISA_SCALAR; id < Kernels::ISA_COUNT;
+	     id++) {
+		auto k = Kernels::get((Kernels::isa)id);
+
+		if (!k) {
+			printf("isa %u: not on this CPU or build, skipped\n",
+			       id);
+			continue;
+		}
+
+		printf("isa %u: %s\n", id, k->name);
+
+		rng r;
+
+		for (auto &m : matrices) {
+			auto c = Kernels::make_coefficients(m.bt601,
+							    m.full_range);
+			test_rows(k, c, r);
+			test_frames(k, c, r);
+			test_padded_frames(k, c, r);
+		}
+
+		test_streams(k, r);
+	}
+
+	CHECK(Kernels::detect() != nullptr, "no kernels detected");
+
+	return result("pixel kernels");
+}
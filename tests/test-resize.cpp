@@ -0,0 +1,248 @@
+#include "ndi5-resize.h"
+#include "ndi5-sender.h"
+#include "test-common.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdint.h>
+#include <string>
+
+// What Texture::prepare rebuilds for a scripted run of resizes, rescales,
+// format and pool changes, against an NDI library that only counts. The
+// sender has to be created once, on the first frame, and never again.
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+namespace Fake {
+
+int creates = 0;
+std::string name;
+bool clocked = true;
+
+static NDIlib_send_instance_t send_create(const NDIlib_send_create_t *desc)
+{
+	creates++;
+	name = desc->p_ndi_name;
+	clocked = desc->clock_video;
+
+	return (NDIlib_send_instance_t)(intptr_t)creates;
+}
+
+static NDIlib_v5 lib()
+{
+	NDIlib_v5 l = {};
+	l.send_create = Fake::send_create;
+	return l;
+}
+
+} // namespace Fake
+
+// Output formats, only telling them apart matters here. Like UYVY on the GPU,
+// A packs from a scaled texture when the output is not the source's size.
+enum { FORMAT_A = 1, FORMAT_B, FORMAT_C };
+
+static const Resize::wanted FIRST = {true, FORMAT_A, 1920, 1080, false, 3,
+				     true};
+
+// The rendition as Texture::prepare leaves it after an action
+static void apply(Resize::built &b, const Resize::wanted &w, Resize::action a,
+		  const NDIlib_v5 &lib)
+{
+	switch (a) {
+	case Resize::CREATE:
+		b.sender = Sender::create(&lib, "test") != nullptr;
+		[[fallthrough]];
+	case Resize::REFORMAT:
+	case Resize::REBUILD:
+		b.allocated = true;
+		b.format = w.format;
+		b.alloc_width = Resize::bucket(w.width);
+		b.alloc_height = Resize::bucket(w.height);
+		b.scaled = w.scaled;
+		b.buffer_count = w.buffer_count;
+		[[fallthrough]];
+	case Resize::RELAYOUT:
+		b.width = w.width;
+		b.height = w.height;
+		b.threaded = w.threaded;
+		break;
+	case Resize::POOLS:
+		b.buffer_count = w.buffer_count;
+		b.threaded = w.threaded;
+		break;
+	case Resize::KEEP:
+		break;
+	}
+}
+
+static void test_bucket()
+{
+	CHECK(Resize::bucket(1) == Resize::BUCKET &&
+		      Resize::bucket(Resize::BUCKET) == Resize::BUCKET &&
+		      Resize::bucket(Resize::BUCKET + 1) == Resize::BUCKET * 2,
+	      "bucket edges");
+	CHECK(Resize::bucket(1080) == 1088, "1080 in %u",
+	      Resize::bucket(1080));
+
+	CHECK(Resize::reusable(1920, 1088, 1920, 1080), "1080p not in 1088");
+	CHECK(!Resize::reusable(1920, 1088, 1921, 1080), "wider reused");
+	CHECK(!Resize::reusable(1920, 1088, 1920, 1089), "taller reused");
+	CHECK(Resize::reusable(1920, 1088, 1664, 936), "3/4 not reused");
+	CHECK(!Resize::reusable(1920, 1088, 640, 360), "1/9 reused");
+}
+
+static void test_plan()
+{
+	Resize::built b = {};
+	const NDIlib_v5 lib = Fake::lib();
+
+	CHECK(Resize::plan(b, FIRST) == Resize::CREATE, "first not created");
+	apply(b, FIRST, Resize::CREATE, lib);
+
+	Resize::wanted w = FIRST;
+	w.resized = false;
+	CHECK(Resize::plan(b, w) == Resize::KEEP, "nothing changed, not kept");
+
+	// Within the buckets, and a source resize whatever the output size
+	Resize::wanted smaller = w;
+	smaller.width = 1900;
+	CHECK(Resize::plan(b, smaller) == Resize::RELAYOUT,
+	      "small resize not laid out again");
+
+	Resize::wanted moved = w;
+	moved.resized = true;
+	CHECK(Resize::plan(b, moved) == Resize::RELAYOUT,
+	      "source resize not laid out again");
+
+	Resize::wanted larger = w;
+	larger.width = 3840;
+	larger.height = 2160;
+	CHECK(Resize::plan(b, larger) == Resize::REBUILD, "4K not rebuilt");
+
+	Resize::wanted scaled = smaller;
+	scaled.scaled = true;
+	CHECK(Resize::plan(b, scaled) == Resize::REBUILD,
+	      "new scaled texture not rebuilt");
+
+	Resize::wanted format = larger;
+	format.format = FORMAT_B;
+	CHECK(Resize::plan(b, format) == Resize::REFORMAT,
+	      "format change not reformatted");
+
+	Resize::wanted pools = w;
+	pools.buffer_count = 5;
+	CHECK(Resize::plan(b, pools) == Resize::POOLS, "buffer count ignored");
+
+	Resize::wanted inline_send = w;
+	inline_send.threaded = false;
+	CHECK(Resize::plan(b, inline_send) == Resize::POOLS,
+	      "send mode ignored");
+
+	CHECK(Fake::creates == 1, "%d senders created", Fake::creates);
+}
+
+static void test_sender()
+{
+	const NDIlib_v5 lib = Fake::lib();
+	const int before = Fake::creates;
+
+	auto sender = Sender::create(&lib, "studio (Program)");
+
+	CHECK(sender && Fake::creates == before + 1, "not created");
+	CHECK(Fake::name == "studio (Program)", "created as '%s'",
+	      Fake::name.c_str());
+	CHECK(!Fake::clocked, "video clocked");
+}
+
+// Random resizes, output scales, formats, buffer counts and send modes, a
+// few frames each, the way a user dragging a source around and changing
+// settings would
+static void test_session()
+{
+	static const uint32_t SIZES[][2] = {
+		{1920, 1080}, {1910, 1076}, {1280, 720}, {3840, 2160},
+		{1080, 1920}, {640, 360},   {7680, 4320}, {1, 1},
+		{1281, 721},  {960, 540},
+	};
+	static const uint32_t FORMATS[] = {FORMAT_A, FORMAT_B, FORMAT_C};
+
+	const NDIlib_v5 lib = Fake::lib();
+	const int before = Fake::creates;
+
+	Resize::built b = {};
+	Resize::wanted w = FIRST;
+	uint32_t source_width = w.width, source_height = w.height;
+	rng r;
+
+	int actions[Resize::POOLS + 1] = {};
+
+	for (int frame = 0; frame < 20000; frame++) {
+		w.resized = false;
+
+		// A change every few frames
+		switch (r.next() % 16) {
+		case 0: {
+			const auto &size = SIZES[r.next() % std::size(SIZES)];
+			w.width = source_width = size[0];
+			w.height = source_height = size[1];
+			w.resized = true;
+			break;
+		}
+		case 1:
+			// Output size or tally scale, same source
+			w.width = std::max<uint32_t>(w.width / 2, 1);
+			w.height = std::max<uint32_t>(w.height / 2, 1);
+			break;
+		case 2:
+			w.format = FORMATS[r.next() % std::size(FORMATS)];
+			break;
+		case 3:
+			w.buffer_count = 2 + r.next() % 6;
+			break;
+		case 4:
+			w.threaded = !w.threaded;
+			break;
+		}
+
+		w.scaled = w.format == FORMAT_A && (w.width != source_width ||
+						    w.height != source_height);
+
+		const auto a = Resize::plan(b, w);
+		actions[a]++;
+		apply(b, w, a, lib);
+
+		CHECK(b.width == w.width && b.height == w.height &&
+			      b.format == w.format &&
+			      b.buffer_count == w.buffer_count &&
+			      b.threaded == w.threaded,
+		      "frame %d: not built for what it asked", frame);
+		CHECK(Resize::reusable(b.alloc_width, b.alloc_height, b.width,
+				       b.height),
+		      "frame %d: %ux%u sent from %ux%u buffers", frame,
+		      b.width, b.height, b.alloc_width, b.alloc_height);
+	}
+
+	printf("kept %d, created %d, reformatted %d, laid out %d, rebuilt %d, pools %d\n",
+	       actions[Resize::KEEP], actions[Resize::CREATE],
+	       actions[Resize::REFORMAT], actions[Resize::RELAYOUT],
+	       actions[Resize::REBUILD], actions[Resize::POOLS]);
+
+	CHECK(Fake::creates == before + 1,
+	      "%d senders created across the session, not 1",
+	      Fake::creates - before);
+
+	// Every kind of change came up
+	for (int a = Resize::REFORMAT; a <= Resize::POOLS; a++)
+		CHECK(actions[a], "action %d never planned", a);
+}
+
+int main()
+{
+	test_bucket();
+	test_plan();
+	test_sender();
+	test_session();
+
+	return result("test-resize");
+}
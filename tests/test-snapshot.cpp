@@ -0,0 +1,176 @@
+#include "ndi5-snapshot.h"
+#include "test-common.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// Settings hammered from one thread while a simulated render loop takes them
+// once per frame, and a properties view reads them now and then -- the way
+// filter_update, filter_video_tick and filter_properties share the filter's
+// config
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+static std::atomic<int> live{0};
+
+// Every field follows from version, a value seen half built or after it was
+// freed does not add up
+struct settings {
+	static constexpr int FIELDS = 32;
+
+	uint64_t version;
+	uint64_t fields[FIELDS];
+	std::string name;
+
+	explicit settings(uint64_t v) : version(v), name(std::to_string(v))
+	{
+		for (int i = 0; i < FIELDS; i++)
+			fields[i] = v * 0x9e3779b97f4a7c15ull + i;
+		live++;
+	}
+
+	~settings()
+	{
+		version = ~0ull;
+		live--;
+	}
+
+	bool intact() const
+	{
+		for (int i = 0; i < FIELDS; i++)
+			if (fields[i] != version * 0x9e3779b97f4a7c15ull + i)
+				return false;
+		return name == std::to_string(version);
+	}
+};
+
+static void test_single_thread()
+{
+	snapshot<settings> published;
+	std::shared_ptr<const settings> current;
+
+	CHECK(!published.load() && !published.take(current),
+	      "nothing published yet");
+
+	published.publish(std::make_shared<const settings>(1));
+
+	CHECK(published.take(current) && current->version == 1,
+	      "first value not taken");
+	CHECK(!published.take(current), "same value taken twice");
+
+	// Held across a newer publish, the old one stays as it was
+	auto held = current;
+	published.publish(std::make_shared<const settings>(2));
+
+	CHECK(held->version == 1 && held->intact(), "held value changed");
+	CHECK(published.take(current) && current->version == 2,
+	      "newer value not taken");
+
+	held.reset();
+	CHECK(live == 1, "%d values alive, only the latest should be",
+	      live.load());
+}
+
+static void test_hammered()
+{
+	static const uint64_t UPDATES = 200000;
+
+	{
+		snapshot<settings> published;
+		published.publish(std::make_shared<const settings>(0));
+
+		std::atomic<bool> done{false};
+		uint64_t torn = 0, backwards = 0, frames = 0, versions = 0;
+		uint64_t viewed = 0, view_torn = 0;
+
+		// filter_update -- built off to the side, published whole. The
+		// yields let the others in between updates on one CPU too.
+		std::thread update([&] {
+			for (uint64_t v = 1; v <= UPDATES; v++) {
+				published.publish(
+					std::make_shared<const settings>(v));
+
+				if (!(v & 15))
+					std::this_thread::yield();
+			}
+			done = true;
+		});
+
+		// filter_properties -- whenever the view is rebuilt
+		std::thread view([&] {
+			while (!done) {
+				auto shown = published.load();
+
+				if (!shown->intact())
+					view_torn++;
+				viewed++;
+
+				std::this_thread::yield();
+			}
+		});
+
+		// filter_video_tick -- one take per frame, kept for the frame.
+		// A send worker keeps the frame before's for a while longer.
+		std::shared_ptr<const settings> config;
+		std::shared_ptr<const settings> worker;
+
+		published.take(config);
+
+		for (bool last = false; !last;) {
+			last = done;
+
+			const uint64_t before = config->version;
+
+			if (published.take(config))
+				versions++;
+
+			if (config->version < before)
+				backwards++;
+
+			// The frame renders with it while updates go on
+			for (int i = 0; i < 4; i++)
+				if (!config->intact() ||
+				    (worker && !worker->intact()))
+					torn++;
+
+			worker = config;
+			frames++;
+
+			std::this_thread::yield();
+		}
+
+		update.join();
+		view.join();
+
+		CHECK(!torn, "%llu frames saw a torn or freed value",
+		      (unsigned long long)torn);
+		CHECK(!view_torn, "%llu views saw a torn or freed value",
+		      (unsigned long long)view_torn);
+		CHECK(!backwards, "%llu frames went back a version",
+		      (unsigned long long)backwards);
+		CHECK(config->version == UPDATES,
+		      "last frame saw version %llu of %llu",
+		      (unsigned long long)config->version,
+		      (unsigned long long)UPDATES);
+
+		printf("%llu updates, %llu frames took %llu, %llu views\n",
+		       (unsigned long long)UPDATES, (unsigned long long)frames,
+		       (unsigned long long)versions,
+		       (unsigned long long)viewed);
+	}
+
+	// Every value superseded was freed by whoever held it last
+	CHECK(live == 0, "%d values leaked", live.load());
+}
+
+int main()
+{
+	test_single_thread();
+	test_hammered();
+
+	return result("test-snapshot");
+}
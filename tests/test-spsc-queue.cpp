@@ -0,0 +1,113 @@
+#include "ndi5-spsc-queue.h"
+#include "test-common.h"
+
+#include <stdint.h>
+#include <thread>
+
+// The ring between the graphics thread and a sender's worker -- ordering,
+// full / empty at the edges, and one producer against one consumer
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+static void test_single_thread()
+{
+	spsc_queue<uint32_t, 4> queue;
+	uint32_t item = 0;
+
+	CHECK(queue.empty() && queue.size() == 0, "new queue not empty");
+	CHECK(!queue.pop(item), "popped from an empty queue");
+
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK(queue.push(i), "push %u of 4 refused", i);
+
+	CHECK(queue.size() == 4, "size %zu, 4 pushed", queue.size());
+	CHECK(!queue.push(99), "pushed past Capacity");
+
+	for (uint32_t i = 0; i < 4; i++) {
+		CHECK(queue.pop(item) && item == i, "pop %u gave %u", i, item);
+		CHECK(queue.size() == 3 - i, "size %zu after %u pops",
+		      queue.size(), i + 1);
+	}
+
+	CHECK(queue.empty(), "not empty after popping everything");
+	CHECK(!queue.pop(item), "popped from a drained queue");
+
+	// Keep the ring part full while the indexes wrap many times over
+	uint32_t pushed = 0, popped = 0;
+
+	for (int round = 0; round < 1000; round++) {
+		while (queue.push(pushed))
+			pushed++;
+		CHECK(queue.size() == 4, "size %zu when full", queue.size());
+
+		for (int i = 0; i < 3 && queue.pop(item); i++, popped++)
+			CHECK(item == popped, "wrapped pop gave %u, wanted %u",
+			      item, popped);
+	}
+
+	while (queue.pop(item)) {
+		CHECK(item == popped, "drain gave %u, wanted %u", item, popped);
+		popped++;
+	}
+
+	CHECK(popped == pushed, "%u popped, %u pushed", popped, pushed);
+}
+
+// Every item arrives once and in order while both ends race. Items carry a
+// sequence number and a checksum of it, so a torn copy shows up too.
+struct item {
+	uint64_t sequence;
+	uint64_t check;
+};
+
+static void test_two_threads()
+{
+	static const uint64_t ITEMS = 2000000;
+
+	spsc_queue<item, 8> queue;
+
+	std::thread producer([&] {
+		for (uint64_t i = 0; i < ITEMS;) {
+			if (queue.push({i, ~i * 0x9e3779b97f4a7c15ull}))
+				i++;
+			else
+				std::this_thread::yield();
+		}
+	});
+
+	uint64_t expected = 0;
+	uint64_t out_of_order = 0;
+	uint64_t torn = 0;
+
+	while (expected < ITEMS) {
+		item got;
+
+		if (!queue.pop(got)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (got.sequence != expected)
+			out_of_order++;
+		if (got.check != ~got.sequence * 0x9e3779b97f4a7c15ull)
+			torn++;
+
+		expected = got.sequence + 1;
+	}
+
+	producer.join();
+
+	CHECK(!out_of_order, "%llu items out of order",
+	      (unsigned long long)out_of_order);
+	CHECK(!torn, "%llu items torn", (unsigned long long)torn);
+	CHECK(queue.empty(), "%zu items left over", queue.size());
+}
+
+int main()
+{
+	test_single_thread();
+	test_two_threads();
+
+	return result("test-spsc-queue");
+}
@@ -0,0 +1,294 @@
+#include "ndi5-staging-depth.h"
+#include "test-common.h"
+
+// Adaptive staging depth driven by scripted map times, one map and one adapt
+// per frame as Staging::map and Staging::adapt do it
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+static const uint64_t STALL_NS = 1000000;
+static const uint64_t FAST_NS = 50000;
+static const uint64_t SLOW_NS = 5000000;
+
+static const Depth::settings SETTINGS = {true, 2, 1, 6, STALL_NS};
+
+// Runs frames with map times from script(frame), counts how the depth moved
+struct moves {
+	int grew = 0;
+	int shrank = 0;
+};
+
+template<typename F>
+static moves run(Depth::state &state, int frames, F &&script,
+		 const Depth::settings &s = SETTINGS)
+{
+	moves m;
+
+	for (int i = 0; i < frames; i++) {
+		state.record(script(i), s);
+
+		switch (state.adapt(s)) {
+		case Depth::GREW:
+			m.grew++;
+			break;
+		case Depth::SHRANK:
+			m.shrank++;
+			break;
+		case Depth::KEPT:
+			break;
+		}
+	}
+
+	return m;
+}
+
+static uint64_t fast(int)
+{
+	return FAST_NS;
+}
+
+static uint64_t slow(int)
+{
+	return SLOW_NS;
+}
+
+static void test_fixed()
+{
+	Depth::settings fixed = SETTINGS;
+	fixed.adaptive = false;
+	fixed.fixed = 3;
+
+	Depth::state state;
+	state.reset(fixed);
+
+	auto m = run(state, Depth::WINDOW * 10, slow, fixed);
+	CHECK(!m.grew && !m.shrank && state.depth() == 3,
+	      "fixed depth moved to %u", state.depth());
+
+	// Turned off while adapted, straight back to fixed
+	Depth::state adapted;
+	adapted.reset(SETTINGS);
+
+	run(adapted, Depth::WINDOW * 3, slow);
+	run(adapted, 1, slow, fixed);
+	CHECK(adapted.depth() == 3, "not back to fixed, at %u",
+	      adapted.depth());
+}
+
+// One step per window of stalls, never before a window is full, never past
+// max
+static void test_grow()
+{
+	Depth::state state;
+	state.reset(SETTINGS);
+
+	run(state, Depth::WINDOW - 1, slow);
+	CHECK(state.depth() == SETTINGS.fixed, "grew before a window was full");
+
+	auto m = run(state, 1, slow);
+	CHECK(m.grew == 1 && state.depth() == SETTINGS.fixed + 1,
+	      "did not grow on a full window of stalls");
+
+	m = run(state, Depth::WINDOW * 20, slow);
+	CHECK(m.grew == (int)(SETTINGS.max - SETTINGS.fixed - 1),
+	      "grew %d times on the way to max", m.grew);
+	CHECK(state.depth() == SETTINGS.max, "at %u, not max %u",
+	      state.depth(), SETTINGS.max);
+}
+
+// Only more than STALL_PERCENT of a window grows it
+static void test_threshold()
+{
+	const int allowed = Depth::WINDOW * Depth::STALL_PERCENT / 100;
+
+	Depth::state under, over, at;
+	under.reset(SETTINGS);
+	over.reset(SETTINGS);
+	at.reset(SETTINGS);
+
+	auto m = run(under, Depth::WINDOW * 10, [allowed](int i) {
+		return i % Depth::WINDOW < allowed ? SLOW_NS : FAST_NS;
+	});
+	CHECK(!m.grew && !m.shrank, "%d stalls a window moved the depth",
+	      allowed);
+
+	m = run(over, Depth::WINDOW, [allowed](int i) {
+		return i <= allowed ? SLOW_NS : FAST_NS;
+	});
+	CHECK(m.grew == 1, "%d stalls a window did not grow", allowed + 1);
+
+	// A map right at the threshold is not a stall
+	m = run(at, Depth::WINDOW, [](int) { return STALL_NS; });
+	CHECK(!m.grew, "maps at the threshold counted as stalls");
+}
+
+// Down one step after CALM_WINDOWS windows without a stall, the count starts
+// over after each step, never below min
+static void test_shrink()
+{
+	Depth::settings s = SETTINGS;
+	s.fixed = 4;
+
+	Depth::state state;
+	state.reset(s);
+
+	run(state, Depth::WINDOW * Depth::CALM_WINDOWS - 1, fast, s);
+	CHECK(state.depth() == 4, "shrank before %u calm windows",
+	      Depth::CALM_WINDOWS);
+
+	auto m = run(state, 1, fast, s);
+	CHECK(m.shrank == 1 && state.depth() == 3,
+	      "did not shrink after %u calm windows", Depth::CALM_WINDOWS);
+
+	m = run(state, Depth::WINDOW * Depth::CALM_WINDOWS - 1, fast, s);
+	CHECK(!m.shrank, "calm count did not start over after a step");
+
+	m = run(state, Depth::WINDOW * Depth::CALM_WINDOWS * 20, fast, s);
+	CHECK(m.shrank == 2 && state.depth() == s.min,
+	      "at %u after shrinking %d more, not min %u", state.depth(),
+	      m.shrank, s.min);
+}
+
+// A single stall, even one too few to grow, breaks a calm streak
+static void test_calm_broken()
+{
+	Depth::settings s = SETTINGS;
+	s.fixed = 4;
+
+	Depth::state state;
+	state.reset(s);
+	const uint32_t streak = Depth::WINDOW * (Depth::CALM_WINDOWS - 1);
+
+	run(state, streak, fast, s);
+	auto m = run(state, Depth::WINDOW, [](int i) {
+		return i == 0 ? SLOW_NS : FAST_NS;
+	}, s);
+	CHECK(!m.grew && !m.shrank, "one stall moved the depth");
+
+	m = run(state, Depth::WINDOW * Depth::CALM_WINDOWS - 1, fast, s);
+	CHECK(!m.shrank, "shrank on a streak a stall broke");
+	m = run(state, 1, fast, s);
+	CHECK(m.shrank == 1, "did not shrink on a new streak");
+}
+
+// New bounds apply on the next frame, whatever the window holds
+static void test_bounds()
+{
+	Depth::state state;
+	state.reset(SETTINGS);
+
+	run(state, Depth::WINDOW * 20, slow);
+
+	Depth::settings lower = SETTINGS;
+	lower.max = 3;
+	run(state, 1, slow, lower);
+	CHECK(state.depth() == 3, "not clamped to a new max, at %u",
+	      state.depth());
+
+	Depth::settings higher = SETTINGS;
+	higher.min = 5;
+	run(state, 1, fast, higher);
+	CHECK(state.depth() == 5, "not clamped to a new min, at %u",
+	      state.depth());
+
+	// Starting outside the bounds
+	Depth::settings outside = SETTINGS;
+	outside.fixed = 8;
+	Depth::state from;
+	from.reset(outside);
+
+	run(from, 1, fast);
+	CHECK(from.depth() == SETTINGS.max, "start not clamped, at %u",
+	      from.depth());
+}
+
+static void test_histogram()
+{
+	CHECK(Depth::bucket(0) == 0, "0 us not in the first bucket");
+
+	for (int i = 0; i < Depth::HISTOGRAM_BUCKETS - 1; i++) {
+		const uint64_t bound = Depth::HISTOGRAM_BOUNDS_US[i] * 1000ull;
+
+		CHECK(Depth::bucket(bound - 1000) == i, "under %u us not in %d",
+		      Depth::HISTOGRAM_BOUNDS_US[i], i);
+		CHECK(Depth::bucket(bound) == i + 1, "%u us not in %d",
+		      Depth::HISTOGRAM_BOUNDS_US[i], i + 1);
+	}
+
+	CHECK(Depth::bucket(~0ull) == Depth::HISTOGRAM_BUCKETS - 1,
+	      "slowest not in the last bucket");
+
+	// Every map counted once, fixed or not
+	Depth::settings fixed = SETTINGS;
+	fixed.adaptive = false;
+
+	Depth::state state;
+	state.reset(SETTINGS);
+
+	run(state, 300, fast);
+	run(state, 200, slow, fixed);
+
+	uint64_t total = 0;
+	for (int i = 0; i < Depth::HISTOGRAM_BUCKETS; i++)
+		total += state.histogram(i);
+
+	CHECK(total == 500, "%llu maps counted of 500",
+	      (unsigned long long)total);
+	CHECK(state.histogram(Depth::bucket(FAST_NS)) == 300 &&
+		      state.histogram(Depth::bucket(SLOW_NS)) == 200,
+	      "maps in the wrong buckets");
+}
+
+// A GPU whose copies take copy frames to land, a map any sooner waits for
+// it. The depth settles on copy and stays within a step of it, stalls are
+// the odd window spent probing one lower.
+static void test_gpu()
+{
+	for (uint32_t copy = SETTINGS.min; copy <= SETTINGS.max; copy++) {
+		Depth::state state;
+		state.reset(SETTINGS);
+
+		uint32_t stalled = 0, above = 0, below = 0;
+		const int frames = Depth::WINDOW * 200;
+
+		for (int i = 0; i < frames; i++) {
+			const uint64_t map_ns =
+				state.depth() < copy ? SLOW_NS : FAST_NS;
+
+			stalled += state.record(map_ns, SETTINGS);
+			state.adapt(SETTINGS);
+
+			// Settled once it first reaches copy
+			if (i > Depth::WINDOW * (int)SETTINGS.max) {
+				above += state.depth() > copy;
+				below += state.depth() + 1 < copy;
+			}
+		}
+
+		CHECK(!above && !below,
+		      "copy %u: depth left %u, %u-1 for %u frames", copy, copy,
+		      copy, above + below);
+
+		// Past start up, at most one window of stalls in every
+		// CALM_WINDOWS + 1
+		const uint32_t most = frames / (Depth::CALM_WINDOWS + 1) +
+				      Depth::WINDOW * SETTINGS.max;
+		CHECK(stalled <= most, "copy %u: %u of %d maps stalled", copy,
+		      stalled, frames);
+	}
+}
+
+int main()
+{
+	test_fixed();
+	test_grow();
+	test_threshold();
+	test_shrink();
+	test_calm_broken();
+	test_bounds();
+	test_histogram();
+	test_gpu();
+
+	return result("test-staging-depth");
+}
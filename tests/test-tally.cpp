@@ -0,0 +1,125 @@
+#include "ndi5-tally.h"
+#include "test-common.h"
+
+// Off air throttling driven by a scripted tally, one update per frame as
+// filter_video_tick does it
+
+using namespace NDI5Filter;
+using namespace NDI5Filter::Tests;
+
+static const Tally::settings SETTINGS = {true, 4, 2, 10};
+
+enum tally { OFF_AIR, PROGRAM, PREVIEW, BOTH };
+
+// Runs frames at one tally, true if every frame gave rate and scale
+static bool run(Tally::state &state, tally t, int frames, uint32_t rate,
+		uint32_t scale, const Tally::settings &s = SETTINGS)
+{
+	const bool program = t == PROGRAM || t == BOTH;
+	const bool preview = t == PREVIEW || t == BOTH;
+	bool held = true;
+
+	for (int i = 0; i < frames; i++) {
+		state.update(program, preview, s);
+		held = held && state.rate() == rate && state.scale() == scale;
+	}
+
+	return held;
+}
+
+static void test_on_air()
+{
+	Tally::state state;
+
+	CHECK(state.rate() == 1 && state.scale() == 1 && !state.off_air(),
+	      "new state throttled");
+
+	CHECK(run(state, PROGRAM, 100, 1, 1), "throttled on program");
+	CHECK(run(state, PREVIEW, 100, 1, 1), "throttled on preview");
+	CHECK(run(state, BOTH, 100, 1, 1), "throttled on both");
+}
+
+// The rate drops on the first frame off air, the size only once off air has
+// held for hold frames
+static void test_off_air()
+{
+	Tally::state state;
+	run(state, PROGRAM, 10, 1, 1);
+
+	CHECK(run(state, OFF_AIR, SETTINGS.hold, 4, 1),
+	      "not rate only for the first %u frames off air", SETTINGS.hold);
+	CHECK(state.off_air(), "not off air");
+	CHECK(run(state, OFF_AIR, 1000, 4, 2), "not fully throttled after %u",
+	      SETTINGS.hold);
+
+	// Back to full at once, either way
+	CHECK(run(state, PREVIEW, 1, 1, 1), "preview not full at once");
+	run(state, OFF_AIR, 100, 4, 2);
+	CHECK(run(state, PROGRAM, 1, 1, 1), "program not full at once");
+	CHECK(!state.off_air(), "still off air on program");
+}
+
+// A mixer cutting back and forth faster than the hold never changes the size,
+// the hold starts over on every cut
+static void test_cuts()
+{
+	Tally::state state;
+	bool size_held = true;
+
+	for (int cut = 0; cut < 50; cut++) {
+		const tally t = cut & 1 ? PROGRAM : OFF_AIR;
+
+		size_held = run(state, t, SETTINGS.hold, t ? 1 : 4, 1) &&
+			    size_held;
+	}
+
+	CHECK(size_held, "size changed by cuts shorter than the hold");
+
+	// One frame on air is enough to start the hold over
+	run(state, OFF_AIR, SETTINGS.hold, 4, 1);
+	run(state, PREVIEW, 1, 1, 1);
+	CHECK(run(state, OFF_AIR, SETTINGS.hold, 4, 1),
+	      "hold not started over by a frame on preview");
+	CHECK(run(state, OFF_AIR, 1, 4, 2), "not scaled after the hold");
+}
+
+static void test_settings()
+{
+	// Throttling off, off air changes nothing
+	Tally::settings off = SETTINGS;
+	off.throttle = false;
+
+	Tally::state state;
+	CHECK(run(state, OFF_AIR, 100, 1, 1, off), "throttled while off");
+	CHECK(!state.off_air(), "off air while throttling is off");
+
+	// No hold, the size drops with the rate
+	Tally::settings now = SETTINGS;
+	now.hold = 0;
+
+	Tally::state immediate;
+	CHECK(run(immediate, OFF_AIR, 1, 4, 2, now), "hold 0 not at once");
+
+	// Turned off while throttled, back to full on the next frame
+	CHECK(run(immediate, OFF_AIR, 1, 1, 1, off),
+	      "not full once turned off");
+
+	// New divisors apply on the next frame, the hold is kept
+	Tally::state changed;
+	run(changed, OFF_AIR, 100, 4, 2);
+
+	Tally::settings more = SETTINGS;
+	more.rate = 8;
+	more.scale = 4;
+	CHECK(run(changed, OFF_AIR, 1, 8, 4, more), "new divisors not used");
+}
+
+int main()
+{
+	test_on_air();
+	test_off_air();
+	test_cuts();
+	test_settings();
+
+	return result("test-tally");
+}